@@ -0,0 +1,237 @@
+/// @file
+///
+/// @brief State that is owned by one thread and mutated through messages.
+
+#pragma once
+
+#include "future.h"
+#include "loop_thread.h"
+#include "thread_dispatcher.h"
+
+#include <QThread>
+
+#include <atomic>
+#include <concepts>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace qu
+{
+
+namespace detail
+{
+
+    /// @brief The state and the mailbox of an actor.
+    ///
+    /// The mailbox is a lock-free multi-producer/single-consumer stack
+    /// of tasks, just like a lane of a @c ThreadDispatcher. Only the
+    /// producer that finds it empty posts a drain task to the thread of the
+    /// actor. The drain task takes all messages at once and runs them in
+    /// FIFO order. Thus a burst of messages costs a single wakeup, and
+    /// actors sharing a thread do not interleave their messages.
+    ///
+    /// Drain tasks keep the core alive, so the actor may be destroyed
+    /// while one of them is still queued.
+    template <typename State>
+    class ActorCore
+        : public std::enable_shared_from_this<ActorCore<State>>
+    {
+    public:
+        template <typename...Args>
+        ActorCore( QThread * thread, Args&&...args )
+            : state( std::forward<Args>(args)... )
+            , thread( thread )
+        {
+        }
+
+        ~ActorCore()
+        {
+            deleteChain( batch );
+            deleteChain( pending.exchange( nullptr ) );
+        }
+
+        /// Enqueues a message. This function is thread-safe and takes
+        /// ownership of @c task.
+        void post( DispatchTask * task )
+        {
+            auto head = pending.load( std::memory_order_relaxed );
+            do
+            {
+                task->next = head;
+            }
+            while ( !pending.compare_exchange_weak( head, task,
+                        std::memory_order_release, std::memory_order_relaxed ) );
+            if ( !head )
+                scheduleDrain();
+        }
+
+        /// Runs all messages enqueued so far. Must be called in the thread
+        /// of the actor.
+        void drain()
+        {
+            if ( !batch )
+            {
+                auto head = pending.exchange( nullptr, std::memory_order_acquire );
+                while ( head )
+                {
+                    const auto next = head->next;
+                    head->next = batch;
+                    batch = head;
+                    head = next;
+                }
+            }
+
+            // If a message throws, then the rest of the batch is run later.
+            struct Guard
+            {
+                ~Guard()
+                {
+                    if ( core.batch )
+                        core.scheduleDrain();
+                }
+                ActorCore & core;
+            } guard{ *this };
+
+            while ( batch )
+            {
+                std::unique_ptr<DispatchTask> task( batch );
+                batch = task->next;
+                (*task)();
+            }
+        }
+
+        State state;
+        QThread * const thread;
+
+    private:
+        static void deleteChain( DispatchTask * task )
+        {
+            while ( task )
+                delete std::exchange( task, task->next );
+        }
+
+        void scheduleDrain()
+        {
+            // Internal, so the drain is neither dropped nor evicted while
+            // messages wait for it.
+            ThreadDispatcher::forThread( thread ).postInternal( new DispatchTask(
+                [core = this->shared_from_this()]()
+                {
+                    core->drain();
+                } ) );
+        }
+
+        // Messages pushed by producers, newest first.
+        std::atomic<DispatchTask*> pending{ nullptr };
+        // Messages taken from @c pending, oldest first. Only accessed by
+        // the thread of the actor.
+        DispatchTask * batch = nullptr;
+    };
+
+} // namespace detail
+
+
+/// @brief An object of type @c State that is only accessed by one thread.
+///
+/// Instead of guarding shared state with a mutex, the state is owned by
+/// the thread of the actor and all accesses are sent there as messages:
+///
+/// @code
+///     qu::Actor<std::vector<Sample>> samples;
+///     samples.tell( [s]( auto & v ){ v.push_back( s ); } );
+///     auto size = samples.ask( []( auto & v ){ return v.size(); } ).get();
+/// @endcode
+///
+/// Messages are functors taking a @c State& argument. They are run one
+/// after the other in the order in which they were sent from the same
+/// thread. The thread of the actor is either a @c LoopThread owned by the
+/// actor or an external thread running a Qt event loop, e.g. a worker of
+/// a @c LoopThreadPool. Several actors may share an external thread.
+///
+/// The state is constructed in the thread creating the actor. Destroying
+/// the actor waits until all messages sent before have been run.
+template <typename State>
+class Actor
+{
+public:
+    /// Constructs the state from @c args and starts a thread for it.
+    template <typename...Args>
+        requires std::constructible_from<State, Args...>
+    explicit Actor( Args&&...args )
+        : ownThread( std::make_unique<LoopThread>() )
+        , core( std::make_shared<detail::ActorCore<State>>(
+                    ownThread.get(), std::forward<Args>(args)... ) )
+    {
+    }
+
+    /// Constructs the state from @c args and runs the messages in the
+    /// event loop of @c thread. The thread must keep running its event
+    /// loop until the actor is destroyed.
+    template <typename...Args>
+        requires std::constructible_from<State, Args...>
+    Actor( QThread * thread, Args&&...args )
+        : core( std::make_shared<detail::ActorCore<State>>(
+                    thread, std::forward<Args>(args)... ) )
+    {
+    }
+
+    ~Actor()
+    {
+        const auto drainCore = core;
+        detail::dispatch( core->thread, [drainCore]{ drainCore->drain(); },
+                          Qt::BlockingQueuedConnection );
+    }
+
+    Actor( const Actor & ) = delete;
+    Actor & operator=( const Actor & ) = delete;
+
+    QThread * thread() const
+    {
+        return core->thread;
+    }
+
+    /// @brief Sends a message without waiting for a result.
+    ///
+    /// @c f is called as @c f(state) in the thread of the actor.
+    /// Exceptions thrown by @c f propagate into the event loop of that
+    /// thread. This function is thread-safe.
+    template <typename F>
+    void tell( F && f )
+    {
+        core->post( new detail::DispatchTask(
+            [f = std::forward<F>(f), state = &core->state]() mutable
+            {
+                f( *state );
+            } ) );
+    }
+
+    /// @brief Sends a message and provides its result through a future.
+    ///
+    /// Exceptions thrown by @c f are stored in the future. If the message
+    /// is never run, then the future receives a @c std::future_error with
+    /// @c std::future_errc::broken_promise. This function is thread-safe.
+    template <typename F>
+    auto ask( F && f ) -> Future<std::invoke_result_t<F&,State&>>
+    {
+        using RetType = std::invoke_result_t<F&,State&>;
+        Promise<RetType> promise;
+        auto future = promise.getFuture();
+        core->post( new detail::DispatchTask( detail::makePromiseTask(
+            std::move(promise),
+            [f = std::forward<F>(f), state = &core->state](
+                Promise<RetType> & promise ) mutable
+            {
+                detail::fulfil( promise, f, *state );
+            } ) ) );
+        return future;
+    }
+
+private:
+    // Declared first, so it is stopped after the last reference of the
+    // actor to the core is gone.
+    std::unique_ptr<LoopThread> ownThread;
+    std::shared_ptr<detail::ActorCore<State>> core;
+};
+
+} // namespace qu
@@ -0,0 +1,90 @@
+/// @file
+///
+/// @brief Helpers shared by the benchmarks of qt_utils.
+///
+/// Every benchmark reports its results through @c report(), which prints
+/// one JSON object per line. Thus the output of two releases can be
+/// compared with standard line-based tools.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+/// A numeric parameter of a benchmark.
+struct Field
+{
+    template <typename T>
+    Field( const char * name, T value )
+        : name( name ), value( double(value) )
+    {
+    }
+
+    const char * name;
+    double value;
+};
+
+/// @brief Prints a result line.
+///
+/// The line contains the name of the benchmark, the given fields and the
+/// measured value with its unit.
+void report( const std::string & name,
+             std::initializer_list<Field> fields,
+             double value, const char * unit );
+
+/// Returns whether the benchmark with the given name has been selected on
+/// the command line.
+bool isSelected( const std::string & name );
+
+/// Heap allocations made by the current thread so far.
+std::size_t allocationsInCurrentThread();
+
+/// Total size in bytes of the heap allocations made by the current thread
+/// so far. Deallocations are not subtracted.
+std::size_t bytesAllocatedInCurrentThread();
+
+/// Process CPU time, i.e. the time consumed by all threads.
+std::chrono::nanoseconds processCpuTime();
+
+/// @brief Runs @c f @c nRepetitions times and returns the median duration.
+///
+/// Taking the median makes results robust against outliers due to
+/// scheduling noise.
+template <typename F>
+std::chrono::nanoseconds medianDuration( int nRepetitions, F && f )
+{
+    std::vector<std::chrono::nanoseconds> durations;
+    for ( int i = 0; i != nRepetitions; ++i )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        durations.push_back( std::chrono::steady_clock::now() - start );
+    }
+    std::nth_element( durations.begin(),
+                      durations.begin() + durations.size() / 2,
+                      durations.end() );
+    return durations[durations.size() / 2];
+}
+
+/// Converts a duration into seconds.
+inline double seconds( std::chrono::nanoseconds d )
+{
+    return std::chrono::duration<double>( d ).count();
+}
+
+// Groups of benchmarks.
+void runActorBenchmarks();
+void runAllocationBenchmarks();
+void runInvokeBenchmarks();
+void runLoopThreadBenchmarks();
+void runEventFilterBenchmarks();
+void runGraphicsItemBenchmarks();
+
+} // namespace bench
@@ -0,0 +1,80 @@
+/// @file
+///
+/// @brief Messages to a @c qu::Actor compared with a mutex-guarded state.
+
+#include "bench.h"
+
+#include "../actor.h"
+
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int nRepetitions = 5;
+const std::size_t nCalls = 200000;
+
+template <typename F>
+void runProducers( int nProducers, F && f )
+{
+    std::vector<std::thread> producers;
+    for ( int i = 0; i != nProducers; ++i )
+        producers.emplace_back( [&]
+        {
+            for ( std::size_t k = 0; k != nCalls / nProducers; ++k )
+                f();
+        } );
+    for ( auto & producer : producers )
+        producer.join();
+}
+
+void benchActorTell( int nProducers )
+{
+    qu::Actor<std::size_t> actor;
+    const auto duration = bench::medianDuration( nRepetitions, [&]
+    {
+        runProducers( nProducers, [&]
+        {
+            actor.tell( []( std::size_t & counter ){ ++counter; } );
+        } );
+        actor.ask( []( std::size_t & ){} ).get();
+    } );
+    const auto total = actor.ask( []( std::size_t & counter ){ return counter; } ).get();
+    if ( total != nRepetitions * ( nCalls / nProducers ) * nProducers )
+        std::abort();
+    bench::report( "actor_tell_throughput",
+                   { { "producers", nProducers }, { "calls", nCalls } },
+                   nCalls / bench::seconds( duration ), "calls/s" );
+}
+
+void benchMutex( int nProducers )
+{
+    std::mutex mutex;
+    std::size_t counter = 0;
+    const auto duration = bench::medianDuration( nRepetitions, [&]
+    {
+        runProducers( nProducers, [&]
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            ++counter;
+        } );
+    } );
+    bench::report( "mutex_update_throughput",
+                   { { "producers", nProducers }, { "calls", nCalls } },
+                   nCalls / bench::seconds( duration ), "calls/s" );
+}
+
+} // unnamed namespace
+
+void bench::runActorBenchmarks()
+{
+    for ( const int nProducers : { 1, 4 } )
+    {
+        if ( isSelected( "actor_tell_throughput" ) )
+            benchActorTell( nProducers );
+        if ( isSelected( "mutex_update_throughput" ) )
+            benchMutex( nProducers );
+    }
+}
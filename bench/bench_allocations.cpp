@@ -0,0 +1,99 @@
+/// @file
+///
+/// @brief Heap allocations per posted call.
+
+#include "bench.h"
+
+#include "../invoke_in_thread.h"
+#include "../loop_thread.h"
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <future>
+
+namespace {
+
+// Posts a burst of @c nCalls functors capturing @c NPointers pointers to
+// @c thread and returns the number of heap allocations the producer made.
+// The consumer is held back while posting, so that the whole burst is
+// drained by a single wakeup.
+template <std::size_t NPointers>
+std::size_t postBurst( QThread * thread, std::size_t nCalls )
+{
+    std::atomic<std::size_t> counter{ 0 };
+    std::array<void*,NPointers> capture{};
+    capture[0] = &counter;
+
+    std::promise<void> entered;
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    qu::postToThread( thread, [&entered,released]()
+    {
+        entered.set_value();
+        released.wait();
+    }, Qt::QueuedConnection );
+    entered.get_future().wait();
+
+    const auto nAllocationsBefore = bench::allocationsInCurrentThread();
+    for ( std::size_t i = 0; i != nCalls; ++i )
+    {
+        qu::postToThread( thread, [capture]()
+        {
+            ++*static_cast<std::atomic<std::size_t>*>( capture[0] );
+        }, Qt::QueuedConnection );
+    }
+    const auto result =
+            bench::allocationsInCurrentThread() - nAllocationsBefore;
+
+    release.set_value();
+    qu::invokeInThreadSync( thread, []{} );
+    if ( counter != nCalls )
+        std::abort();
+    return result;
+}
+
+template <std::size_t NPointers>
+void benchPostAllocations( QThread * thread )
+{
+    const std::size_t nCalls = 100000;
+    // The first burst fills the task pool.
+    postBurst<NPointers>( thread, nCalls );
+    const auto allocations = postBurst<NPointers>( thread, nCalls );
+    bench::report( "post_allocations",
+                   { { "captured_pointers", NPointers },
+                     { "calls", nCalls } },
+                   double(allocations) / nCalls, "allocations/call" );
+}
+
+// Allocations of a round trip through @c invokeInThread(), which needs
+// a shared state for its future.
+void benchInvokeAllocations( QThread * thread )
+{
+    const std::size_t nCalls = 10000;
+    for ( std::size_t i = 0; i != nCalls; ++i )
+        qu::invokeInThread( thread, []{ return 0; } ).get();
+    const auto nAllocationsBefore = bench::allocationsInCurrentThread();
+    for ( std::size_t i = 0; i != nCalls; ++i )
+        qu::invokeInThread( thread, []{ return 0; } ).get();
+    const auto allocations =
+            bench::allocationsInCurrentThread() - nAllocationsBefore;
+    bench::report( "invoke_allocations", { { "calls", nCalls } },
+                   double(allocations) / nCalls, "allocations/call" );
+}
+
+} // unnamed namespace
+
+void bench::runAllocationBenchmarks()
+{
+    qu::LoopThread thread;
+    if ( isSelected( "post_allocations" ) )
+    {
+        benchPostAllocations<1>( &thread );
+        benchPostAllocations<2>( &thread );
+        benchPostAllocations<4>( &thread );
+        benchPostAllocations<5>( &thread );
+    }
+    if ( isSelected( "invoke_allocations" ) )
+        benchInvokeAllocations( &thread );
+}
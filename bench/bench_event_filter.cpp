@@ -0,0 +1,201 @@
+/// @file
+///
+/// @brief Dispatch and installation cost of @c qu::GenericEventFilter,
+///     @c qu::StaticEventFilter and @c qu::EventFilterRouter.
+
+#include "bench.h"
+
+#include "../event_filter.h"
+#include "../event_filter_router.h"
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QObject>
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace {
+
+const int nRepetitions = 5;
+
+// Sends @c nEvents events to an object with @c nFilters installed
+// filters, each of which lets the event pass.
+void benchEventFilterDispatch( int nFilters )
+{
+    const std::size_t nEvents = 200000;
+    const auto type = QEvent::Type( QEvent::User + 1 );
+    QObject receiver;
+    std::size_t nFiltered = 0;
+    for ( int i = 0; i != nFilters; ++i )
+        qu::installEventFilter( &receiver,
+            [&nFiltered,type]( QObject *, QEvent * event )
+            {
+                nFiltered += event->type() == type;
+                return false;
+            } );
+    const auto sendAll = [&]
+    {
+        for ( std::size_t i = 0; i != nEvents; ++i )
+        {
+            QEvent event( type );
+            QCoreApplication::sendEvent( &receiver, &event );
+        }
+    };
+    sendAll();
+    const auto duration = bench::medianDuration( nRepetitions, sendAll );
+    if ( nFiltered != nEvents * nFilters * ( nRepetitions + 1 ) )
+        std::abort();
+    bench::report( "event_filter_dispatch",
+                   { { "filters", nFilters }, { "events", nEvents } },
+                   std::chrono::duration<double,std::nano>( duration ).count()
+                   / nEvents, "ns/event" );
+}
+
+// Like benchEventFilterDispatch(), but the filters are only interested
+// in an event type that is never sent, so they reject all events by
+// their type.
+void benchTypedEventFilterDispatch( int nFilters )
+{
+    const std::size_t nEvents = 200000;
+    const auto type = QEvent::Type( QEvent::User + 1 );
+    QObject receiver;
+    std::size_t nFiltered = 0;
+    for ( int i = 0; i != nFilters; ++i )
+        qu::installEventFilter( &receiver, { QEvent::MouseMove },
+            [&nFiltered]( QObject *, QEvent * )
+            {
+                ++nFiltered;
+                return false;
+            } );
+    const auto sendAll = [&]
+    {
+        for ( std::size_t i = 0; i != nEvents; ++i )
+        {
+            QEvent event( type );
+            QCoreApplication::sendEvent( &receiver, &event );
+        }
+    };
+    sendAll();
+    const auto duration = bench::medianDuration( nRepetitions, sendAll );
+    if ( nFiltered != 0 )
+        std::abort();
+    bench::report( "event_filter_typed_dispatch",
+                   { { "filters", nFilters }, { "events", nEvents } },
+                   std::chrono::duration<double,std::nano>( duration ).count()
+                   / nEvents, "ns/event" );
+}
+
+// Like benchEventFilterDispatch() with a single filter, but with a
+// filter composed at compile time.
+void benchStaticEventFilterDispatch()
+{
+    const std::size_t nEvents = 200000;
+    const auto type = QEvent::Type( QEvent::User + 1 );
+    QObject receiver;
+    std::size_t nFiltered = 0;
+    qu::installStaticEventFilter( &receiver,
+        qu::onEvent<QEvent::MouseMove,QEvent::Wheel>(
+            []( QObject *, QEvent * ) { return false; } ),
+        qu::onEvent<QEvent::Type( QEvent::User + 1 )>(
+            [&nFiltered]( QObject *, QEvent * )
+            {
+                ++nFiltered;
+                return false;
+            } ) );
+    const auto sendAll = [&]
+    {
+        for ( std::size_t i = 0; i != nEvents; ++i )
+        {
+            QEvent event( type );
+            QCoreApplication::sendEvent( &receiver, &event );
+        }
+    };
+    sendAll();
+    const auto duration = bench::medianDuration( nRepetitions, sendAll );
+    if ( nFiltered != nEvents * ( nRepetitions + 1 ) )
+        std::abort();
+    bench::report( "event_filter_static_dispatch",
+                   { { "filters", 1 }, { "events", nEvents } },
+                   std::chrono::duration<double,std::nano>( duration ).count()
+                   / nEvents, "ns/event" );
+}
+
+// Installs a filter on each of @c nObjects objects, either with a filter
+// object per object or through the application-wide router.
+void benchEventFilterInstall( bool isRouted )
+{
+    const std::size_t nObjects = 10000;
+    std::vector<std::unique_ptr<QObject>> objects;
+    for ( std::size_t i = 0; i != nObjects; ++i )
+        objects.push_back( std::make_unique<QObject>() );
+    const auto filter = []( QObject *, QEvent * ) { return false; };
+    // Creates the router outside of the measurement.
+    qu::EventFilterRouter::forApplication();
+
+    const auto nAllocationsBefore = bench::allocationsInCurrentThread();
+    const auto start = std::chrono::steady_clock::now();
+    for ( const auto & object : objects )
+    {
+        if ( isRouted )
+            qu::installRoutedEventFilter( object.get(), QEvent::MouseMove, filter );
+        else
+            qu::installEventFilter( object.get(), { QEvent::MouseMove }, filter );
+    }
+    const auto duration = std::chrono::steady_clock::now() - start;
+    const auto nAllocations =
+            bench::allocationsInCurrentThread() - nAllocationsBefore;
+    bench::report( "event_filter_install",
+                   { { "routed", isRouted }, { "objects", nObjects } },
+                   std::chrono::duration<double,std::nano>( duration ).count()
+                   / nObjects, "ns/object" );
+    bench::report( "event_filter_install_allocations",
+                   { { "routed", isRouted }, { "objects", nObjects } },
+                   double(nAllocations) / nObjects, "allocations/object" );
+
+    if ( !isRouted )
+        return;
+    // Events to an object with a routed filter.
+    std::size_t nFiltered = 0;
+    qu::installRoutedEventFilter( objects.front().get(), QEvent::MouseMove,
+        [&nFiltered]( QObject *, QEvent * )
+        {
+            ++nFiltered;
+            return false;
+        } );
+    const std::size_t nEvents = 200000;
+    const auto sendAll = [&]
+    {
+        for ( std::size_t i = 0; i != nEvents; ++i )
+        {
+            QEvent event( QEvent::MouseMove );
+            QCoreApplication::sendEvent( objects.front().get(), &event );
+        }
+    };
+    const auto dispatchDuration = bench::medianDuration( nRepetitions, sendAll );
+    if ( nFiltered != nEvents * nRepetitions )
+        std::abort();
+    bench::report( "event_filter_routed_dispatch",
+                   { { "objects", nObjects }, { "events", nEvents } },
+                   std::chrono::duration<double,std::nano>(
+                       dispatchDuration ).count() / nEvents, "ns/event" );
+}
+
+} // unnamed namespace
+
+void bench::runEventFilterBenchmarks()
+{
+    if ( isSelected( "event_filter_dispatch" ) )
+        for ( const int nFilters : { 0, 1, 4 } )
+            benchEventFilterDispatch( nFilters );
+    if ( isSelected( "event_filter_typed_dispatch" ) )
+        for ( const int nFilters : { 1, 4 } )
+            benchTypedEventFilterDispatch( nFilters );
+    if ( isSelected( "event_filter_static_dispatch" ) )
+        benchStaticEventFilterDispatch();
+    if ( isSelected( "event_filter_install" ) ||
+         isSelected( "event_filter_routed_dispatch" ) )
+        for ( const bool isRouted : { false, true } )
+            benchEventFilterInstall( isRouted );
+}
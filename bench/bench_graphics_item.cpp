@@ -0,0 +1,288 @@
+/// @file
+///
+/// @brief Memory footprint, construction time and event dispatch cost of
+///     @c qu::EventHandlingGraphicsItem, @c qu::GraphicsItemDelegates and
+///     @c qu::InstancedGraphicsItem.
+
+#include "bench.h"
+
+#include "../event_handling_graphics_item.h"
+#include "../instanced_graphics_item.h"
+
+#include <QGraphicsRectItem>
+#include <QGraphicsScene>
+#include <QGraphicsSceneHoverEvent>
+#include <QGraphicsSceneMouseEvent>
+
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Item = qu::EventHandlingGraphicsItem<QGraphicsRectItem>;
+
+const int nRepetitions = 5;
+
+// How the handlers of the items are set up.
+enum class Handlers
+{
+    // Plain QGraphicsRectItems for comparison.
+    None,
+    // No handler set.
+    Default,
+    // The same handler set, shared by all items.
+    Shared,
+    // A handler set on each item.
+    Own,
+    // A handler registered in the delegates of the scene.
+    Delegated,
+};
+
+// Constructs @c nItems items and reports the time and the heap memory
+// needed per item.
+void benchGraphicsItemConstruction( Handlers handlers )
+{
+    const std::size_t nItems = 1000000;
+    std::vector<std::unique_ptr<QGraphicsItem>> items;
+    items.reserve( nItems );
+    const auto handler = []( Item * item, QGraphicsSceneMouseEvent * )
+    {
+        item->update();
+    };
+
+    const auto nBytesBefore = bench::bytesAllocatedInCurrentThread();
+    const auto start = std::chrono::steady_clock::now();
+    for ( std::size_t i = 0; i != nItems; ++i )
+    {
+        if ( handlers == Handlers::None )
+        {
+            items.push_back( std::make_unique<QGraphicsRectItem>( 0, 0, 1, 1 ) );
+            continue;
+        }
+        auto item = std::make_unique<Item>( 0, 0, 1, 1 );
+        if ( handlers == Handlers::Own ||
+             ( handlers == Handlers::Shared && i == 0 ) )
+            item->setMousePressEventHandler( handler );
+        else if ( handlers == Handlers::Shared )
+            item->shareHandlersWith( static_cast<Item&>( *items.front() ) );
+        items.push_back( std::move(item) );
+    }
+    const auto duration = std::chrono::steady_clock::now() - start;
+    const auto nBytes = bench::bytesAllocatedInCurrentThread() - nBytesBefore;
+
+    bench::report( "graphics_item_construction",
+                   { { "handlers", int(handlers) }, { "items", nItems } },
+                   std::chrono::duration<double,std::nano>( duration ).count()
+                   / nItems, "ns/item" );
+    bench::report( "graphics_item_bytes",
+                   { { "handlers", int(handlers) }, { "items", nItems } },
+                   double(nBytes) / nItems, "bytes/item" );
+}
+
+// Sends mouse move and hover move events to each item of a dense scene
+// and reports the time per event.
+void benchGraphicsItemDispatch( Handlers handlers )
+{
+    const int nColumns = 100;
+    const std::size_t nItems = nColumns * nColumns;
+    const std::size_t nRounds = 20;
+    QGraphicsScene scene( 0, 0, nColumns, nColumns );
+    std::size_t nHandled = 0;
+    for ( std::size_t i = 0; i != nItems; ++i )
+    {
+        const auto x = double( i % nColumns );
+        const auto y = double( i / nColumns );
+        if ( handlers == Handlers::None )
+        {
+            scene.addItem( new QGraphicsRectItem( x, y, 1, 1 ) );
+            continue;
+        }
+        const auto item = new Item( x, y, 1, 1 );
+        if ( handlers == Handlers::Own )
+        {
+            item->setMouseMoveEventHandler(
+                [&nHandled]( Item *, QGraphicsSceneMouseEvent * event )
+                {
+                    nHandled += event->buttons() == Qt::NoButton;
+                } );
+            item->setHoverMoveEventHandler(
+                [&nHandled]( Item *, QGraphicsSceneHoverEvent * event )
+                {
+                    nHandled += event->modifiers() == Qt::NoModifier;
+                } );
+        }
+        scene.addItem( item );
+    }
+    if ( handlers == Handlers::Delegated )
+    {
+        auto & delegates = qu::GraphicsItemDelegates::forScene( &scene );
+        delegates.setMouseMoveEventHandler( QGraphicsRectItem::Type,
+            [&nHandled]( QGraphicsItem *, QGraphicsSceneMouseEvent * event )
+            {
+                nHandled += event->buttons() == Qt::NoButton;
+                return true;
+            } );
+        delegates.setHoverMoveEventHandler( QGraphicsRectItem::Type,
+            [&nHandled]( QGraphicsItem *, QGraphicsSceneHoverEvent * event )
+            {
+                nHandled += event->modifiers() == Qt::NoModifier;
+                return true;
+            } );
+    }
+    const auto items = scene.items();
+
+    QGraphicsSceneMouseEvent mouseMove( QEvent::GraphicsSceneMouseMove );
+    QGraphicsSceneHoverEvent hoverMove( QEvent::GraphicsSceneHoverMove );
+    const auto sendAll = [&]
+    {
+        for ( std::size_t round = 0; round != nRounds; ++round )
+            for ( const auto item : items )
+            {
+                scene.sendEvent( item, &mouseMove );
+                scene.sendEvent( item, &hoverMove );
+            }
+    };
+    sendAll();
+    const auto duration = bench::medianDuration( nRepetitions, sendAll );
+    const auto nEvents = 2 * nRounds * nItems;
+    if ( handlers != Handlers::None && handlers != Handlers::Default &&
+         nHandled != nEvents * ( nRepetitions + 1 ) )
+        std::abort();
+    bench::report( "graphics_item_dispatch",
+                   { { "handlers", int(handlers) }, { "items", nItems } },
+                   std::chrono::duration<double,std::nano>( duration ).count()
+                   / nEvents, "ns/event" );
+}
+
+// Switches the mouse press handler of @c nItems items, either on every
+// item or once in the delegates of the scene, and reports the time per
+// switch.
+void benchGraphicsItemModeSwitch( Handlers handlers )
+{
+    const std::size_t nItems = 500000;
+    QGraphicsScene scene;
+    std::vector<Item*> items;
+    for ( std::size_t i = 0; i != nItems; ++i )
+    {
+        items.push_back( new Item( 0, 0, 1, 1 ) );
+        scene.addItem( items.back() );
+    }
+    auto & delegates = qu::GraphicsItemDelegates::forScene( &scene );
+
+    int mode = 0;
+    const auto duration = bench::medianDuration( nRepetitions, [&]
+    {
+        ++mode;
+        if ( handlers == Handlers::Own )
+            for ( const auto item : items )
+                item->setMousePressEventHandler(
+                    [mode]( Item * item, QGraphicsSceneMouseEvent * )
+                    {
+                        item->setData( 0, mode );
+                    } );
+        else
+            delegates.setMousePressEventHandler( QGraphicsRectItem::Type,
+                [mode]( QGraphicsItem * item, QGraphicsSceneMouseEvent * )
+                {
+                    item->setData( 0, mode );
+                    return true;
+                } );
+    } );
+    bench::report( "graphics_item_mode_switch",
+                   { { "handlers", int(handlers) }, { "items", nItems } },
+                   std::chrono::duration<double,std::milli>( duration ).count(),
+                   "ms" );
+}
+
+// Adds @c nElements elements to an instanced item and reports the time
+// and the heap memory needed per element, for comparison with
+// graphics_item_construction and graphics_item_bytes.
+void benchInstancedGraphicsItemConstruction()
+{
+    const std::size_t nElements = 1000000;
+    const int nColumns = 1000;
+    const auto nBytesBefore = bench::bytesAllocatedInCurrentThread();
+    const auto start = std::chrono::steady_clock::now();
+    qu::InstancedGraphicsItem item;
+    item.reserve( nElements );
+    const auto handlerId = item.addHandlers();
+    item.setMousePressEventHandler( handlerId,
+        []( qu::InstancedGraphicsItem * item, std::size_t index,
+            QGraphicsSceneMouseEvent * )
+        {
+            item->update( item->elementRect( index ) );
+        } );
+    for ( std::size_t i = 0; i != nElements; ++i )
+        item.addElement( QPointF( double( i % nColumns ), double( i / nColumns ) ),
+                         QSizeF( 1, 1 ), Qt::black, handlerId );
+    // Includes the grid built on the first hit test.
+    item.elementAt( QPointF( 0, 0 ) );
+    const auto duration = std::chrono::steady_clock::now() - start;
+    const auto nBytes = bench::bytesAllocatedInCurrentThread() - nBytesBefore;
+
+    bench::report( "instanced_graphics_item_construction",
+                   { { "elements", nElements } },
+                   std::chrono::duration<double,std::nano>( duration ).count()
+                   / nElements, "ns/element" );
+    bench::report( "instanced_graphics_item_bytes",
+                   { { "elements", nElements } },
+                   double(nBytes) / nElements, "bytes/element" );
+}
+
+// Hit tests random positions within a scatter plot of @c nElements
+// elements and reports the time per hit test.
+void benchInstancedGraphicsItemHitTest( std::size_t nElements )
+{
+    const auto extent = 1000.;
+    const std::size_t nQueries = 100000;
+    std::mt19937 random;
+    std::uniform_real_distribution<double> coordinate( 0, extent );
+    qu::InstancedGraphicsItem item;
+    item.reserve( nElements );
+    for ( std::size_t i = 0; i != nElements; ++i )
+        item.addElement( QPointF( coordinate( random ), coordinate( random ) ),
+                         QSizeF( 2, 2 ), Qt::black );
+    std::vector<QPointF> positions;
+    for ( std::size_t i = 0; i != nQueries; ++i )
+        positions.emplace_back( coordinate( random ), coordinate( random ) );
+    item.elementAt( positions.front() );
+
+    std::size_t nHits = 0;
+    const auto duration = bench::medianDuration( nRepetitions, [&]
+    {
+        for ( const auto & pos : positions )
+            nHits += item.elementAt( pos ) != qu::InstancedGraphicsItem::noElement;
+    } );
+    if ( nElements > 0 && nHits == 0 )
+        std::abort();
+    bench::report( "instanced_graphics_item_hit_test",
+                   { { "elements", nElements } },
+                   std::chrono::duration<double,std::nano>( duration ).count()
+                   / nQueries, "ns/query" );
+}
+
+} // unnamed namespace
+
+void bench::runGraphicsItemBenchmarks()
+{
+    if ( isSelected( "graphics_item_construction" ) ||
+         isSelected( "graphics_item_bytes" ) )
+        for ( const auto handlers : { Handlers::None, Handlers::Default,
+                                      Handlers::Shared, Handlers::Own } )
+            benchGraphicsItemConstruction( handlers );
+    if ( isSelected( "graphics_item_dispatch" ) )
+        for ( const auto handlers : { Handlers::None, Handlers::Default,
+                                      Handlers::Own, Handlers::Delegated } )
+            benchGraphicsItemDispatch( handlers );
+    if ( isSelected( "graphics_item_mode_switch" ) )
+        for ( const auto handlers : { Handlers::Own, Handlers::Delegated } )
+            benchGraphicsItemModeSwitch( handlers );
+    if ( isSelected( "instanced_graphics_item_construction" ) ||
+         isSelected( "instanced_graphics_item_bytes" ) )
+        benchInstancedGraphicsItemConstruction();
+    if ( isSelected( "instanced_graphics_item_hit_test" ) )
+        for ( const std::size_t nElements : { 10000, 1000000 } )
+            benchInstancedGraphicsItemHitTest( nElements );
+}
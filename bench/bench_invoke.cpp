@@ -0,0 +1,197 @@
+/// @file
+///
+/// @brief Throughput and latency of cross-thread invocations.
+
+#include "bench.h"
+
+#include "../invoke_in_thread.h"
+#include "../latency_histogram.h"
+#include "../loop_thread.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int nRepetitions = 5;
+
+// Posts @c nCallsPerProducer functors from each of @c nProducers plain
+// threads to @c thread and waits until all of them have run.
+void postFromProducers( QThread * thread, int nProducers,
+                        std::size_t nCallsPerProducer )
+{
+    std::atomic<std::size_t> counter{ 0 };
+    std::vector<std::thread> producers;
+    for ( int i = 0; i != nProducers; ++i )
+    {
+        producers.emplace_back( [&]
+        {
+            for ( std::size_t k = 0; k != nCallsPerProducer; ++k )
+                qu::postToThread( thread,
+                    [&counter]{ counter.fetch_add( 1, std::memory_order_relaxed ); },
+                    Qt::QueuedConnection );
+        } );
+    }
+    for ( auto & producer : producers )
+        producer.join();
+    qu::invokeInThreadSync( thread, []{} );
+    if ( counter != nProducers * nCallsPerProducer )
+        std::abort();
+}
+
+void benchPostThroughput( QThread * thread, int nProducers )
+{
+    const std::size_t nCallsPerProducer = 200000 / nProducers;
+    postFromProducers( thread, nProducers, nCallsPerProducer );
+    const auto duration = bench::medianDuration( nRepetitions, [&]
+    {
+        postFromProducers( thread, nProducers, nCallsPerProducer );
+    } );
+    const double nCalls = double(nProducers) * nCallsPerProducer;
+    bench::report( "post_throughput",
+                   { { "producers", nProducers }, { "calls", nCalls } },
+                   nCalls / bench::seconds( duration ), "calls/s" );
+}
+
+// Each of @c nProducers plain threads posts to a loop thread of its own.
+// The producers share no queue, so the throughput scales with their number
+// unless they contend on something else, such as the lookup of the
+// dispatchers.
+void benchPostToOwnThreads( int nProducers )
+{
+    std::vector<std::unique_ptr<qu::LoopThread>> threads;
+    for ( int i = 0; i != nProducers; ++i )
+        threads.push_back( std::make_unique<qu::LoopThread>() );
+    const std::size_t nCallsPerProducer = 200000;
+    std::atomic<std::size_t> counter{ 0 };
+    const auto run = [&]
+    {
+        std::vector<std::thread> producers;
+        for ( int i = 0; i != nProducers; ++i )
+        {
+            producers.emplace_back( [&, thread = threads[i].get()]
+            {
+                for ( std::size_t k = 0; k != nCallsPerProducer; ++k )
+                    qu::postToThread( thread,
+                        [&counter]{ counter.fetch_add( 1, std::memory_order_relaxed ); },
+                        Qt::QueuedConnection );
+                qu::invokeInThreadSync( thread, []{} );
+            } );
+        }
+        for ( auto & producer : producers )
+            producer.join();
+    };
+    run();
+    const auto duration = bench::medianDuration( nRepetitions, run );
+    if ( counter != ( nRepetitions + 1 ) * nProducers * nCallsPerProducer )
+        std::abort();
+    const double nCalls = double(nProducers) * nCallsPerProducer;
+    bench::report( "post_throughput_own_threads",
+                   { { "producers", nProducers }, { "calls", nCalls } },
+                   nCalls / bench::seconds( duration ), "calls/s" );
+}
+
+// Reports percentiles of the round trip time of @c invoke.
+template <typename F>
+void benchRoundTrip( const char * name, F invoke )
+{
+    const std::size_t nCalls = 20000;
+    for ( std::size_t i = 0; i != nCalls / 10; ++i )
+        invoke();
+    qu::detail::LatencyHistogram histogram;
+    for ( std::size_t i = 0; i != nCalls; ++i )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        invoke();
+        histogram.record( std::chrono::steady_clock::now() - start );
+    }
+    const auto summary = histogram.summarize();
+    const auto us = []( std::chrono::nanoseconds d )
+    {
+        return std::chrono::duration<double,std::micro>( d ).count();
+    };
+    bench::report( name, { { "calls", nCalls },
+                           { "p99_us", us( summary.p99 ) },
+                           { "max_us", us( summary.max ) } },
+                   us( summary.p50 ), "us" );
+}
+
+// CPU time consumed by the process while @c nThreads loop threads and
+// the current thread are idle.
+void benchIdleCpu( int nThreads )
+{
+    std::vector<std::unique_ptr<qu::LoopThread>> threads;
+    for ( int i = 0; i != nThreads; ++i )
+    {
+        threads.push_back( std::make_unique<qu::LoopThread>() );
+        // Make sure each dispatcher exists and has been woken once.
+        qu::invokeInThreadSync( threads.back().get(), []{} );
+    }
+    const auto wallTime = std::chrono::seconds( 1 );
+    const auto cpuBefore = bench::processCpuTime();
+    std::this_thread::sleep_for( wallTime );
+    const auto cpuTime = bench::processCpuTime() - cpuBefore;
+    bench::report( "idle_cpu", { { "threads", nThreads } },
+                   100 * bench::seconds( cpuTime ) / bench::seconds( wallTime ),
+                   "%" );
+}
+
+// Schedules @c nTimers timeouts spread over 100 ms and waits until all of
+// them have expired.
+void benchTimers()
+{
+    const std::size_t nTimers = 100000;
+    qu::LoopThread thread;
+    std::atomic<std::size_t> counter{ 0 };
+    const auto start = std::chrono::steady_clock::now();
+    for ( std::size_t i = 0; i != nTimers; ++i )
+        qu::invokeInThreadAfter( &thread,
+            std::chrono::microseconds( i % 100000 ),
+            [&counter]{ counter.fetch_add( 1, std::memory_order_relaxed ); } );
+    const auto scheduled = std::chrono::steady_clock::now();
+    while ( counter != nTimers )
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    bench::report( "timer_schedule", { { "timers", nTimers } },
+                   nTimers / bench::seconds( scheduled - start ), "timers/s" );
+}
+
+} // unnamed namespace
+
+void bench::runInvokeBenchmarks()
+{
+    qu::LoopThread thread;
+    if ( isSelected( "post_throughput" ) )
+        for ( const int nProducers : { 1, 2, 4, 8 } )
+            benchPostThroughput( &thread, nProducers );
+    if ( isSelected( "post_throughput_own_threads" ) )
+        for ( const int nProducers : { 1, 2, 4, 8 } )
+            benchPostToOwnThreads( nProducers );
+    if ( isSelected( "invoke_sync_round_trip" ) )
+        benchRoundTrip( "invoke_sync_round_trip", [&]
+        {
+            qu::invokeInThreadSync( &thread, []{ return 0; } );
+        } );
+    if ( isSelected( "invoke_sync_round_trip_low_latency" ) )
+    {
+        qu::LoopThreadOptions options;
+        options.mode = qu::LoopThreadMode::LowLatency;
+        qu::LoopThread lowLatencyThread( options );
+        benchRoundTrip( "invoke_sync_round_trip_low_latency", [&]
+        {
+            qu::invokeInThreadSync( &lowLatencyThread, []{ return 0; } );
+        } );
+    }
+    if ( isSelected( "invoke_future_round_trip" ) )
+        benchRoundTrip( "invoke_future_round_trip", [&]
+        {
+            qu::invokeInThread( &thread, []{ return 0; } ).get();
+        } );
+    if ( isSelected( "timer_schedule" ) )
+        benchTimers();
+    if ( isSelected( "idle_cpu" ) )
+        for ( const int nThreads : { 1, 16 } )
+            benchIdleCpu( nThreads );
+}
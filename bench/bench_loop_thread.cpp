@@ -0,0 +1,55 @@
+/// @file
+///
+/// @brief Startup and shutdown cost of @c qu::LoopThread.
+
+#include "bench.h"
+
+#include "../invoke_in_thread.h"
+#include "../loop_thread.h"
+
+#include <memory>
+
+namespace {
+
+const int nRepetitions = 5;
+
+// Measures the time from construction of a thread until it has run a
+// posted call, and the time needed to destroy it afterwards.
+void benchStartupShutdown()
+{
+    const int nThreads = 100;
+    std::chrono::nanoseconds startup{ 0 };
+    std::chrono::nanoseconds shutdown{ 0 };
+    const auto total = bench::medianDuration( nRepetitions, [&]
+    {
+        for ( int i = 0; i != nThreads; ++i )
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto thread = std::make_unique<qu::LoopThread>();
+            qu::invokeInThreadSync( thread.get(), []{} );
+            auto stop = std::chrono::steady_clock::now();
+            startup += stop - start;
+            thread.reset();
+            shutdown += std::chrono::steady_clock::now() - stop;
+        }
+    } );
+    const auto us = []( std::chrono::nanoseconds d )
+    {
+        return std::chrono::duration<double,std::micro>( d ).count();
+    };
+    const double nSamples = double(nThreads) * nRepetitions;
+    bench::report( "loop_thread_startup", { { "threads", nThreads } },
+                   us( startup ) / nSamples, "us" );
+    bench::report( "loop_thread_shutdown", { { "threads", nThreads } },
+                   us( shutdown ) / nSamples, "us" );
+    bench::report( "loop_thread_lifetime", { { "threads", nThreads } },
+                   us( total ) / nThreads, "us" );
+}
+
+} // unnamed namespace
+
+void bench::runLoopThreadBenchmarks()
+{
+    if ( isSelected( "loop_thread" ) )
+        benchStartupShutdown();
+}
@@ -0,0 +1,108 @@
+/// @file
+///
+/// @brief Benchmark suite for the threading primitives of qt_utils.
+///
+/// Results are printed as one JSON object per line, so that the output
+/// of two releases can be diffed. The suite runs headless on the
+/// offscreen platform. Command line arguments select the benchmarks
+/// whose names contain one of them; without arguments all benchmarks
+/// are run.
+
+#include "bench.h"
+
+#include <QApplication>
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Heap allocations made by the current thread and their total size.
+thread_local std::size_t nAllocations = 0;
+thread_local std::size_t nAllocatedBytes = 0;
+
+std::vector<std::string> filters;
+
+} // unnamed namespace
+
+void * operator new( std::size_t size )
+{
+    ++nAllocations;
+    nAllocatedBytes += size;
+    if ( const auto p = std::malloc( size ? size : 1 ) )
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete( void * p ) noexcept
+{
+    std::free( p );
+}
+
+void operator delete( void * p, std::size_t ) noexcept
+{
+    std::free( p );
+}
+
+namespace bench
+{
+
+void report( const std::string & name,
+             std::initializer_list<Field> fields,
+             double value, const char * unit )
+{
+    std::printf( "{\"benchmark\":\"%s\"", name.c_str() );
+    for ( const auto & field : fields )
+        std::printf( ",\"%s\":%g", field.name, field.value );
+    std::printf( ",\"value\":%g,\"unit\":\"%s\"}\n", value, unit );
+    std::fflush( stdout );
+}
+
+bool isSelected( const std::string & name )
+{
+    if ( filters.empty() )
+        return true;
+    for ( const auto & filter : filters )
+        if ( name.find( filter ) != std::string::npos )
+            return true;
+    return false;
+}
+
+std::size_t allocationsInCurrentThread()
+{
+    return nAllocations;
+}
+
+std::size_t bytesAllocatedInCurrentThread()
+{
+    return nAllocatedBytes;
+}
+
+std::chrono::nanoseconds processCpuTime()
+{
+    timespec ts{};
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+    return std::chrono::seconds( ts.tv_sec )
+         + std::chrono::nanoseconds( ts.tv_nsec );
+}
+
+} // namespace bench
+
+int main( int argc, char * argv[] )
+{
+    qputenv( "QT_QPA_PLATFORM", "offscreen" );
+    QApplication app( argc, argv );
+    for ( int i = 1; i < argc; ++i )
+        filters.emplace_back( argv[i] );
+
+    bench::runAllocationBenchmarks();
+    bench::runInvokeBenchmarks();
+    bench::runLoopThreadBenchmarks();
+    bench::runActorBenchmarks();
+    bench::runEventFilterBenchmarks();
+    bench::runGraphicsItemBenchmarks();
+}
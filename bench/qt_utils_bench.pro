@@ -0,0 +1,22 @@
+QT       += core gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+QMAKE_CXXFLAGS += -std=c++20 -pedantic
+
+TEMPLATE = app
+TARGET = qt_utils_bench
+CONFIG += console c++2a link_prl
+CONFIG -= app_bundle
+DEPENDPATH += . .. ../../cpp_utils/
+INCLUDEPATH += ../..
+
+# Input
+HEADERS += bench.h
+SOURCES += bench_actor.cpp \
+           bench_allocations.cpp \
+           bench_event_filter.cpp \
+           bench_graphics_item.cpp \
+           bench_invoke.cpp \
+           bench_loop_thread.cpp \
+           bench_main.cpp
+
+LIBS += -L.. -lqt_utils -L../../cpp_utils -lcpp_utils
@@ -5,36 +5,113 @@
 
 #pragma once
 
+#include <QEvent>
 #include <QObject>
 
+#include <algorithm>
+#include <bitset>
 #include <functional>
+#include <initializer_list>
+#include <map>
 #include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "../cpp_utils/std_make_unique.h"
 
 
-class QEvent;
-
 namespace qu
 {
 
 class GenericEventFilter;
 
+/// @brief A set of event types.
+///
+/// Membership of the types predefined by Qt is a single bit test. User
+/// event types are looked up in a small sorted array.
+class EventTypeSet
+{
+public:
+    /// Creates an empty set.
+    EventTypeSet() = default;
+
+    EventTypeSet( std::initializer_list<QEvent::Type> types )
+    {
+        for ( const auto type : types )
+            insert( type );
+    }
+
+    /// Returns a set containing all event types.
+    static EventTypeSet all()
+    {
+        EventTypeSet result;
+        result.predefined.set();
+        result.isAllUserTypes = true;
+        return result;
+    }
+
+    void insert( QEvent::Type type )
+    {
+        if ( type < QEvent::User )
+            predefined.set( type );
+        else
+        {
+            const auto pos = std::lower_bound(
+                        userTypes.begin(), userTypes.end(), type );
+            if ( pos == userTypes.end() || *pos != type )
+                userTypes.insert( pos, type );
+        }
+    }
+
+    bool contains( QEvent::Type type ) const
+    {
+        if ( type < QEvent::User )
+            return predefined.test( type );
+        return isAllUserTypes ||
+                std::binary_search( userTypes.begin(), userTypes.end(), type );
+    }
+
+private:
+    std::bitset<QEvent::User> predefined;
+    std::vector<QEvent::Type> userTypes;
+    bool isAllUserTypes = false;
+};
+
+/// Handlers of an event filter by event type. The handlers have the
+/// signature of @c QObject::eventFilter().
+using EventHandlerMap =
+    std::map<QEvent::Type,std::function<bool(QObject*,QEvent*)>>;
+
 /// @brief Creates an event filter with @c f as filter function.
 ///
 /// The functor @f must have the signature @c bool(QObject*,QEvent*) just
 /// as the function @c QObject::eventFilter(). A pointer to an object will
 /// be returned which executes the moved or copied functor whenever
-/// @c QObject::eventFilter() is called. 
+/// @c QObject::eventFilter() is called.
 template <typename F>
 std::unique_ptr<QObject> makeEventFilter( F && f )
 {
     return std::make_unique<GenericEventFilter>( std::forward<F>(f) );
 }
 
+/// Like @c makeEventFilter(F&&), but @c f is only called for events
+/// whose type is in @c types. All other events pass the filter.
+template <typename F>
+std::unique_ptr<QObject> makeEventFilter( EventTypeSet types, F && f )
+{
+    return std::make_unique<GenericEventFilter>(
+                std::move(types), std::forward<F>(f) );
+}
+
+/// Creates an event filter that calls the handler registered for the
+/// type of an event. Events of other types pass the filter.
+inline std::unique_ptr<QObject> makeEventFilter( EventHandlerMap handlers );
+
 
 /// @brief Creates and installs an event filter.
-/// 
+///
 /// The function creates an event filter with @c makeEventFilter and then
 /// installs it on the given object @c obj. The functor @f must have the
 /// signature @c bool(QObject*,QEvent*) just as the function
@@ -49,30 +126,206 @@ void installEventFilter( QObject * obj, F && f )
     filter.release();
 }
 
+/// @brief Like @c installEventFilter(QObject*,F&&), but @c f is only
+/// called for events whose type is in @c types.
+///
+/// This is much cheaper for busy objects, since all other events are
+/// passed on after a single bit test, e.g.
+/// @code
+///   qu::installEventFilter( widget, { QEvent::MouseMove, QEvent::Wheel },
+///       []( QObject *, QEvent * event ) { ... } );
+/// @endcode
+template <typename F>
+void installEventFilter( QObject * obj, EventTypeSet types, F && f )
+{
+    auto filter = makeEventFilter( std::move(types), std::forward<F>(f) );
+    filter->setParent( obj );
+    obj->installEventFilter( filter.get() );
+    filter.release();
+}
+
+/// Like @c installEventFilter(QObject*,EventTypeSet,F&&), but with a
+/// separate handler per event type.
+inline void installEventFilter( QObject * obj, EventHandlerMap handlers );
+
 
 /// @brief Event filter class with customizable event filter function.
-/// 
-/// At construction a functor is passed which is moved or copied into 
+///
+/// At construction a functor is passed which is moved or copied into
 /// the @c GenericEventFilter. When @c @QObject::eventFilter() is called
 /// then its arguments will be forwarded to the moved or copied functor.
-class GenericEventFilter 
+/// Optionally, the functor is only called for a set of event types, or
+/// there is one functor per event type. Other events are rejected by
+/// a bit test without calling any functor.
+class GenericEventFilter
     : public QObject
 {
     Q_OBJECT
 public:
-    template <typename F>
+    using Handler = std::function<bool(QObject*,QEvent*)>;
+
+    template <typename F, typename = std::enable_if_t<
+                  std::is_invocable_r_v<bool,F&,QObject*,QEvent*>>>
     GenericEventFilter( F && f )
-        : f(std::forward<F>(f))
+        : types( EventTypeSet::all() )
+        , f(std::forward<F>(f))
+    {
+    }
+
+    template <typename F>
+    GenericEventFilter( EventTypeSet types, F && f )
+        : types( std::move(types) )
+        , f(std::forward<F>(f))
+    {
+    }
+
+    explicit GenericEventFilter( EventHandlerMap handlers )
     {
+        for ( auto & handler : handlers )
+        {
+            types.insert( handler.first );
+            this->handlers.emplace_back(
+                        handler.first, std::move(handler.second) );
+        }
     }
 
     virtual bool eventFilter( QObject * receiver, QEvent * event )
     {
-        return f(receiver,event);
+        const auto type = event->type();
+        if ( !types.contains( type ) )
+            return false;
+        if ( handlers.empty() )
+            return f(receiver,event);
+        // The handlers are sorted by type, since they come from a map.
+        const auto pos = std::lower_bound(
+                    handlers.begin(), handlers.end(), type,
+                    []( const auto & handler, QEvent::Type type )
+                    {
+                        return handler.first < type;
+                    } );
+        return pos->second(receiver,event);
+    }
+
+private:
+    EventTypeSet types;
+    Handler f;
+    std::vector<std::pair<QEvent::Type,Handler>> handlers;
+};
+
+
+/// @brief A handler for events of the given types that is composed into
+/// a @c StaticEventFilter. Created by @c onEvent().
+template <typename F, QEvent::Type...Types>
+struct StaticEventHandler
+{
+    static constexpr bool handles( QEvent::Type type )
+    {
+        return ( ( type == Types ) || ... );
+    }
+
+    bool operator()( QObject * receiver, QEvent * event )
+    {
+        if constexpr ( std::is_void_v<std::invoke_result_t<F&,QObject*,QEvent*>> )
+        {
+            f( receiver, event );
+            return false;
+        }
+        else
+            return f( receiver, event );
+    }
+
+    F f;
+};
+
+/// @brief Tags @c f with the event types it handles, e.g.
+/// @code
+///   qu::onEvent<QEvent::MouseMove,QEvent::HoverMove>(
+///       []( QObject * receiver, QEvent * event ) { ... } )
+/// @endcode
+///
+/// The functor must have the signature @c bool(QObject*,QEvent*) or
+/// @c void(QObject*,QEvent*). Returning nothing means the event is passed
+/// on.
+template <QEvent::Type...Types, typename F>
+StaticEventHandler<std::decay_t<F>,Types...> onEvent( F && f )
+{
+    static_assert( sizeof...(Types) > 0, "At least one event type is needed." );
+    return { std::forward<F>(f) };
+}
+
+/// @brief An event filter composed from handlers at compile time.
+///
+/// Unlike @c GenericEventFilter no handler is type-erased, so the
+/// handlers can be inlined into @c eventFilter(). The comparisons of the
+/// event type with the handled types are unrolled, which the compiler
+/// turns into a switch. Events are passed to the first handler handling
+/// their type. Events of other types pass the filter. Being a template,
+/// the class has no meta object of its own.
+template <typename...Handlers>
+class StaticEventFilter
+    : public QObject
+{
+public:
+    explicit StaticEventFilter( Handlers...handlers )
+        : handlers( std::move(handlers)... )
+    {
+    }
+
+    virtual bool eventFilter( QObject * receiver, QEvent * event ) override
+    {
+        return dispatch( receiver, event,
+                         std::index_sequence_for<Handlers...>() );
     }
 
 private:
-    std::function<bool(QObject*,QEvent*)> f;
+    template <std::size_t...Is>
+    bool dispatch( QObject * receiver, QEvent * event,
+                   std::index_sequence<Is...> )
+    {
+        const auto type = event->type();
+        bool result = false;
+        ( ( Handlers::handles( type ) &&
+            ( result = std::get<Is>( handlers )( receiver, event ), true ) )
+          || ... );
+        return result;
+    }
+
+    std::tuple<Handlers...> handlers;
 };
 
+/// @brief Creates a @c StaticEventFilter from handlers created by
+/// @c onEvent().
+template <typename...Handlers>
+std::unique_ptr<StaticEventFilter<Handlers...>> makeStaticEventFilter(
+        Handlers...handlers )
+{
+    return std::make_unique<StaticEventFilter<Handlers...>>(
+                std::move(handlers)... );
+}
+
+/// Like @c installEventFilter(), but with a @c StaticEventFilter.
+template <typename...Handlers>
+void installStaticEventFilter( QObject * obj, Handlers...handlers )
+{
+    auto filter = makeStaticEventFilter( std::move(handlers)... );
+    filter->setParent( obj );
+    obj->installEventFilter( filter.get() );
+    filter.release();
+}
+
+
+inline std::unique_ptr<QObject> makeEventFilter( EventHandlerMap handlers )
+{
+    return std::make_unique<GenericEventFilter>( std::move(handlers) );
+}
+
+
+inline void installEventFilter( QObject * obj, EventHandlerMap handlers )
+{
+    auto filter = makeEventFilter( std::move(handlers) );
+    filter->setParent( obj );
+    obj->installEventFilter( filter.get() );
+    filter.release();
+}
+
 } // namespace qu
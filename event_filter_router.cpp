@@ -0,0 +1,188 @@
+#include "event_filter_router.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+#include <cassert>
+#include <cstdint>
+
+namespace qu {
+
+namespace { // unnamed
+
+EventFilterRouter * applicationRouter = nullptr;
+
+} // unnamed namespace
+
+
+std::size_t EventFilterRouter::KeyHash::operator()( const Key & key ) const
+{
+    // Objects are aligned, so the low bits of their addresses carry
+    // little information. Mixing with a multiplication spreads them.
+    const auto address = std::uint64_t(
+                reinterpret_cast<std::uintptr_t>( key.receiver ) );
+    return std::size_t( ( address ^ ( std::uint64_t( key.type ) << 48 ) ) *
+                        0x9E3779B97F4A7C15ull >> 16 );
+}
+
+
+EventFilterRouter::EventFilterRouter( Scope scope, QObject * parent )
+    : QObject( parent )
+    , scope( scope )
+{
+    if ( scope == Scope::ApplicationWide )
+        QCoreApplication::instance()->installEventFilter( this );
+}
+
+
+EventFilterRouter::~EventFilterRouter()
+{
+    if ( applicationRouter == this )
+        applicationRouter = nullptr;
+    for ( const auto & receiver : receivers )
+        disconnect( receiver.second.destroyedConnection );
+}
+
+
+EventFilterRouter & EventFilterRouter::forApplication()
+{
+    if ( !applicationRouter )
+    {
+        const auto app = QCoreApplication::instance();
+        assert( app );
+        assert( QThread::currentThread() == app->thread() );
+        applicationRouter = new EventFilterRouter( Scope::ApplicationWide, app );
+    }
+    return *applicationRouter;
+}
+
+
+void EventFilterRouter::setHandler(
+        QObject * receiver, QEvent::Type type, Handler handler )
+{
+    assert( receiver );
+    // Qt ignores event filters living in another thread than the receiver.
+    assert( receiver->thread() == thread() );
+    const auto inserted = handlers.try_emplace( Key{ receiver, type } );
+    if ( !inserted.second )
+    {
+        if ( dispatchDepth == 0 )
+        {
+            inserted.first->second = std::move(handler);
+            return;
+        }
+        // The old handler might be running.
+        erase( inserted.first );
+        setHandler( receiver, type, std::move(handler) );
+        return;
+    }
+    inserted.first->second = std::move(handler);
+    addType( type );
+
+    auto & info = receivers[receiver];
+    if ( info.nHandlers++ == 0 )
+    {
+        info.destroyedConnection = connect(
+                    receiver, &QObject::destroyed, this, [this,receiver]()
+        {
+            removeHandlers( receiver );
+        }, Qt::DirectConnection );
+        if ( scope == Scope::PerReceiver )
+            receiver->installEventFilter( this );
+    }
+}
+
+
+void EventFilterRouter::removeHandler( QObject * receiver, QEvent::Type type )
+{
+    const auto pos = handlers.find( Key{ receiver, type } );
+    if ( pos != handlers.end() )
+        erase( pos );
+}
+
+
+void EventFilterRouter::removeHandlers( QObject * receiver )
+{
+    if ( receivers.find( receiver ) == receivers.end() )
+        return;
+    // Copy the types, since the loop may remove some of them.
+    std::vector<QEvent::Type> registeredTypes;
+    for ( const auto & typeCount : typeCounts )
+        registeredTypes.push_back( typeCount.first );
+    for ( const auto type : registeredTypes )
+        removeHandler( receiver, type );
+}
+
+
+std::size_t EventFilterRouter::handlerCount() const
+{
+    return handlers.size();
+}
+
+
+bool EventFilterRouter::eventFilter( QObject * receiver, QEvent * event )
+{
+    const auto type = event->type();
+    if ( !types.contains( type ) )
+        return false;
+    const auto pos = handlers.find( Key{ receiver, type } );
+    if ( pos == handlers.end() )
+        return false;
+
+    struct Guard
+    {
+        ~Guard()
+        {
+            if ( --self->dispatchDepth == 0 )
+                self->retiredHandlers.clear();
+        }
+        EventFilterRouter * self;
+    } guard{ this };
+    ++dispatchDepth;
+    return pos->second( receiver, event );
+}
+
+
+void EventFilterRouter::erase( HandlerMap::iterator pos )
+{
+    const auto receiver = pos->first.receiver;
+    const auto type = pos->first.type;
+    if ( dispatchDepth > 0 )
+        retiredHandlers.push_back( handlers.extract( pos ) );
+    else
+        handlers.erase( pos );
+    removeType( type );
+
+    const auto info = receivers.find( receiver );
+    assert( info != receivers.end() );
+    if ( --info->second.nHandlers == 0 )
+    {
+        disconnect( info->second.destroyedConnection );
+        if ( scope == Scope::PerReceiver )
+            receiver->removeEventFilter( this );
+        receivers.erase( info );
+    }
+}
+
+
+void EventFilterRouter::addType( QEvent::Type type )
+{
+    if ( typeCounts[type]++ == 0 )
+        types.insert( type );
+}
+
+
+void EventFilterRouter::removeType( QEvent::Type type )
+{
+    const auto pos = typeCounts.find( type );
+    assert( pos != typeCounts.end() );
+    if ( --pos->second != 0 )
+        return;
+    typeCounts.erase( pos );
+    // Types are rarely removed, so rebuilding the set is fine.
+    types = EventTypeSet();
+    for ( const auto & typeCount : typeCounts )
+        types.insert( typeCount.first );
+}
+
+} // namespace qu
@@ -0,0 +1,152 @@
+/// @file
+///
+/// @brief One event filter object serving the handlers of many receivers.
+
+#pragma once
+
+#include "event_filter.h"
+
+#include <QEvent>
+#include <QMetaObject>
+#include <QObject>
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace qu
+{
+
+/// @brief An event filter that dispatches events to handlers registered
+/// per receiver and event type.
+///
+/// Installing a @c GenericEventFilter per watched object costs a
+/// @c QObject per object. A router is a single @c QObject for all of
+/// them. The handlers are kept in a hash map keyed by receiver and event
+/// type, and events of types without any handler are rejected by a bit
+/// test. Handlers of a receiver are removed automatically when it is
+/// destroyed. Handlers may add and remove handlers, including themselves.
+///
+/// With @c Scope::ApplicationWide the router is installed on the
+/// application object only, so no watched object has an event filter of
+/// its own. Qt calls application event filters for objects living in the
+/// gui thread only. With @c Scope::PerReceiver the router installs itself
+/// on each receiver, which takes one entry in the filter list of the
+/// receiver, but no @c QObject. Note that a filter installed on an
+/// ancestor would not see the events of its children, which is why there
+/// is no such scope.
+///
+/// A router must only be used in the thread it lives in, and only objects
+/// living in the same thread can be watched, since Qt ignores event
+/// filters of other threads. Objects of other threads need a router with
+/// @c Scope::PerReceiver living in their thread.
+class EventFilterRouter
+    : public QObject
+{
+    Q_OBJECT
+public:
+    using Handler = std::function<bool(QObject*,QEvent*)>;
+
+    enum class Scope
+    {
+        ApplicationWide,
+        PerReceiver,
+    };
+
+    explicit EventFilterRouter(
+            Scope scope = Scope::ApplicationWide
+            , QObject * parent = nullptr );
+
+    virtual ~EventFilterRouter();
+
+    /// @brief Returns the application-wide router of the gui thread.
+    ///
+    /// It is created on first use as a child of the application object.
+    static EventFilterRouter & forApplication();
+
+    /// @brief Sets the handler for events of @c type sent to @c receiver.
+    ///
+    /// The handler has the signature of @c QObject::eventFilter(). A
+    /// previous handler for the same receiver and type is replaced.
+    void setHandler( QObject * receiver, QEvent::Type type, Handler handler );
+
+    /// Removes the handler for events of @c type sent to @c receiver,
+    /// if there is one.
+    void removeHandler( QObject * receiver, QEvent::Type type );
+
+    /// Removes all handlers of @c receiver.
+    void removeHandlers( QObject * receiver );
+
+    /// Returns the number of registered handlers.
+    std::size_t handlerCount() const;
+
+    virtual bool eventFilter( QObject * receiver, QEvent * event ) override;
+
+private:
+    struct Key
+    {
+        QObject * receiver;
+        QEvent::Type type;
+
+        bool operator==( const Key & other ) const
+        {
+            return receiver == other.receiver && type == other.type;
+        }
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()( const Key & key ) const;
+    };
+
+    struct Receiver
+    {
+        std::size_t nHandlers = 0;
+        QMetaObject::Connection destroyedConnection;
+    };
+
+    using HandlerMap = std::unordered_map<Key,Handler,KeyHash>;
+
+    void erase( HandlerMap::iterator pos );
+    void addType( QEvent::Type type );
+    void removeType( QEvent::Type type );
+
+    const Scope scope;
+    // The map is node based, so handlers are not moved while they run.
+    HandlerMap handlers;
+    std::unordered_map<const QObject*,Receiver> receivers;
+    // Types with at least one handler and their numbers of handlers.
+    EventTypeSet types;
+    std::map<QEvent::Type,std::size_t> typeCounts;
+    // Handlers removed while handlers are running are kept alive until
+    // all of them have returned.
+    int dispatchDepth = 0;
+    std::vector<HandlerMap::node_type> retiredHandlers;
+};
+
+
+/// @brief Like @c installEventFilter(), but the handler is registered at
+/// the application-wide router instead of creating a filter object.
+///
+/// @c obj must live in the gui thread. A previous handler of @c obj for
+/// the same event type is replaced.
+template <typename F>
+void installRoutedEventFilter( QObject * obj, QEvent::Type type, F && f )
+{
+    EventFilterRouter::forApplication().setHandler(
+                obj, type, std::forward<F>(f) );
+}
+
+/// Like @c installRoutedEventFilter(QObject*,QEvent::Type,F&&), but with
+/// a handler per event type.
+inline void installRoutedEventFilter( QObject * obj, EventHandlerMap handlers )
+{
+    auto & router = EventFilterRouter::forApplication();
+    for ( auto & handler : handlers )
+        router.setHandler( obj, handler.first, std::move(handler.second) );
+}
+
+} // namespace qu
@@ -5,12 +5,31 @@
 
 #pragma once
 
+#include "graphics_item_delegates.h"
+
 #include <QGraphicsItem>
 #include <functional>
+#include <memory>
 
 namespace qu
 {
 
+/// @brief A graphics item whose event handlers can be replaced by functors.
+///
+/// The handlers are not stored in the item itself. An item refers to a
+/// table of handlers, which is shared copy-on-write: items without custom
+/// handlers share none at all, and items configured alike can share one
+/// table with @c shareHandlersWith(). Setting a handler on an item that
+/// shares its table gives the item a copy of its own first. Thus an item
+/// costs a single shared pointer and a category in addition to @c T.
+/// Custom handlers are called in place without copying them.
+///
+/// Events without a custom handler go to the handler of the category of
+/// the item in the @c GraphicsItemDelegates of the scene, if there is one,
+/// and otherwise straight to the handler of @c T.
+///
+/// Like any graphics item, the item must only be used in the thread of its
+/// scene, since it accesses the registry of the scene without locking.
 template <typename T>
 class EventHandlingGraphicsItem
         : public T
@@ -18,58 +37,154 @@ class EventHandlingGraphicsItem
 public:
     using T::T;
 
+    /// The replaceable handlers of an item. An empty handler means that
+    /// the default handler is called.
+    struct Handlers
+    {
+#define DECLARE_EVENT_HANDLER( EventName, eventName, EventType ) \
+        std::function<void(EventHandlingGraphicsItem*,EventType*)> eventName;
+
+        QU_FOR_EACH_GRAPHICS_ITEM_EVENT( DECLARE_EVENT_HANDLER )
+
+#undef DECLARE_EVENT_HANDLER
+    };
+
+    virtual ~EventHandlingGraphicsItem()
+    {
+        setTable( nullptr );
+    }
+
+    /// Makes this item use the same handlers as @c other, until a handler
+    /// of either of them is set.
+    void shareHandlersWith( const EventHandlingGraphicsItem & other )
+    {
+        setTable( other.handlers );
+    }
+
+    /// Returns whether the item uses the same handler table as @c other.
+    bool sharesHandlersWith( const EventHandlingGraphicsItem & other ) const
+    {
+        return handlers == other.handlers;
+    }
+
+    /// @brief Sets the category under which the handlers of the item are
+    /// looked up in the @c GraphicsItemDelegates of the scene.
+    ///
+    /// By default, and if @c category is 0, the category is @c type().
+    void setHandlerCategory( int category )
+    {
+        this->category = category;
+    }
+
+    int getHandlerCategory() const
+    {
+        return category != 0 ? category : this->type();
+    }
+
+private:
+    struct Table
+        : Handlers
+    {
+        Table() = default;
+
+        explicit Table( const Handlers & other )
+            : Handlers( other )
+        {
+        }
+
+        // Number of handlers of this table that are running.
+        int nRunning = 0;
+        // Set when no item refers to the table anymore, while one of its
+        // handlers is running. Reset when the handler returns.
+        std::shared_ptr<Table> keepAlive;
+    };
+
+    /// Returns the handler table of this item for modification.
+    Handlers & getOwnHandlers()
+    {
+        if ( !handlers )
+            setTable( std::make_shared<Table>() );
+        else if ( handlers.use_count() > 1 || handlers->nRunning > 0 )
+            setTable( std::make_shared<Table>(
+                          static_cast<const Handlers&>( *handlers ) ) );
+        return *handlers;
+    }
+
+    /// Replaces the handler table of this item. A table that is running
+    /// a handler keeps itself alive, when its last item lets go of it.
+    void setTable( std::shared_ptr<Table> table )
+    {
+        if ( handlers && handlers->nRunning > 0 && handlers.use_count() == 1 )
+            handlers->keepAlive = handlers;
+        handlers = std::move(table);
+    }
+
+    /// Calls the handler @c handler of the table of this item. The
+    /// table is neither changed nor destroyed while the handler runs,
+    /// even if the handler sets handlers or deletes the item.
+    template <typename EventType>
+    void callHandler(
+            std::function<void(EventHandlingGraphicsItem*,EventType*)> Handlers::* handler,
+            EventType * event )
+    {
+        Table & table = *handlers;
+        struct Guard
+        {
+            ~Guard()
+            {
+                if ( --table.nRunning == 0 && table.keepAlive )
+                    const auto last = std::move(table.keepAlive);
+            }
+            Table & table;
+        } guard{ table };
+        ++table.nRunning;
+        (table.*handler)( this, event );
+    }
+
+    // Null, if no handler has been set.
+    std::shared_ptr<Table> handlers;
+    int category = 0;
+
 #define IMPLEMENT_EVENT_HANDLER( EventName, eventName, EventType ) \
 public: \
     std::function<void(EventHandlingGraphicsItem*,EventType*)> get##EventName##Handler() \
     { \
-        return eventName##Handler; \
+        if ( handlers && handlers->eventName ) \
+            return handlers->eventName; \
+        return getDefault##EventName##Handler(); \
     } \
 \
     template <typename F> \
     void set##EventName##Handler( F && f ) \
     { \
-        eventName##Handler = std::forward<F>(f); \
+        getOwnHandlers().eventName = std::forward<F>(f); \
     }\
 \
 protected: \
     virtual void eventName(EventType * event) override \
     { \
-        get##EventName##Handler()(this,event); \
+        if ( !handlers || !handlers->eventName ) \
+            return callDefault_##eventName( event ); \
+        callHandler( &Handlers::eventName, event ); \
     } \
 \
 private: \
-    std::function<void(EventHandlingGraphicsItem*,EventType*)> eventName##Handler \
-        = getDefault##EventName##Handler(); \
-\
     std::function<void(EventHandlingGraphicsItem*,EventType*)> \
         getDefault##EventName##Handler() \
     { \
         return [](EventHandlingGraphicsItem * item, EventType * event) \
-            { item->callBase_##eventName(event); }; \
+            { item->callDefault_##eventName(event); }; \
     } \
 \
-    void callBase_##eventName(EventType * event) \
+    void callDefault_##eventName(EventType * event) \
     { \
+        if ( const auto delegates = GraphicsItemDelegates::find( this->scene() ) ) \
+            if ( delegates->handle##EventName( this, getHandlerCategory(), event ) ) \
+                return; \
         T::eventName( event ); \
     }
 
-    IMPLEMENT_EVENT_HANDLER( DragEnterEvent       , dragEnterEvent       , QGraphicsSceneDragDropEvent )
-    IMPLEMENT_EVENT_HANDLER( DragLeaveEvent       , dragLeaveEvent       , QGraphicsSceneDragDropEvent )
-    IMPLEMENT_EVENT_HANDLER( DragMoveEvent        , dragMoveEvent        , QGraphicsSceneDragDropEvent )
-    IMPLEMENT_EVENT_HANDLER( DropEvent            , dropEvent            , QGraphicsSceneDragDropEvent )
-    IMPLEMENT_EVENT_HANDLER( FocusInEvent         , focusInEvent         , QFocusEvent                 )
-    IMPLEMENT_EVENT_HANDLER( FocusOutEvent        , focusOutEvent        , QFocusEvent                 )
-    IMPLEMENT_EVENT_HANDLER( HoverEnterEvent      , hoverEnterEvent      , QGraphicsSceneHoverEvent    )
-    IMPLEMENT_EVENT_HANDLER( HoverLeaveEvent      , hoverLeaveEvent      , QGraphicsSceneHoverEvent    )
-    IMPLEMENT_EVENT_HANDLER( HoverMoveEvent       , hoverMoveEvent       , QGraphicsSceneHoverEvent    )
-    IMPLEMENT_EVENT_HANDLER( InputMethodEvent     , inputMethodEvent     , QInputMethodEvent           )
-    IMPLEMENT_EVENT_HANDLER( KeyPressEvent        , keyPressEvent        , QKeyEvent                   )
-    IMPLEMENT_EVENT_HANDLER( KeyReleaseEvent      , keyReleaseEvent      , QKeyEvent                   )
-    IMPLEMENT_EVENT_HANDLER( MouseDoubleClickEvent, mouseDoubleClickEvent, QGraphicsSceneMouseEvent    )
-    IMPLEMENT_EVENT_HANDLER( MouseMoveEvent       , mouseMoveEvent       , QGraphicsSceneMouseEvent    )
-    IMPLEMENT_EVENT_HANDLER( MousePressEvent      , mousePressEvent      , QGraphicsSceneMouseEvent    )
-    IMPLEMENT_EVENT_HANDLER( MouseReleaseEvent    , mouseReleaseEvent    , QGraphicsSceneMouseEvent    )
-    IMPLEMENT_EVENT_HANDLER( WheelEvent           , wheelEvent           , QGraphicsSceneWheelEvent    )
+    QU_FOR_EACH_GRAPHICS_ITEM_EVENT( IMPLEMENT_EVENT_HANDLER )
 
 #undef IMPLEMENT_EVENT_HANDLER
 };
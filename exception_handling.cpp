@@ -1,25 +1,71 @@
 #include "exception_handling.h"
 
 #include "invoke_in_thread.h"
+#include "loop_thread.h"
 #include "../cpp_utils/exception_handling.h"
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <exception>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <QCoreApplication>
 #include <QMessageBox>
+#include <QPointer>
+#include <QThread>
 
 namespace qu {
 
-void handleException()
+namespace { // unnamed
+
+using Clock = std::chrono::steady_clock;
+
+// The notification is updated at most this often.
+const auto minUpdateInterval = std::chrono::milliseconds( 500 );
+// A problem that has not occurred for this long starts a new storm.
+const auto stormTimeout = std::chrono::seconds( 10 );
+// Beyond this many problems, the one that occurred least recently is
+// forgotten.
+const std::size_t maxProblems = 64;
+// At most this many problems are listed in the notification.
+const std::size_t maxListedProblems = 5;
+
+// Repeated occurrences of an exception with the same chain of reasons.
+struct Problem
 {
-    auto p = std::current_exception();
-    assert( p != std::exception_ptr() );
-    const auto chain = cu::getExceptionChain( p );
+    // Composed when the problem occurs for the first time.
+    QString mainMessage;
+    QString reasons;
+    // Occurrences since the problem has started to occur again.
+    std::uint64_t nOccurrences = 0;
+    Clock::time_point first;
+    Clock::time_point last;
+    bool isDismissed = false;
+};
 
-    if ( cu::hasUserCancelledException(chain) )
-        return;
+std::mutex problemsMutex;
+// Keyed by the what chain, joined with newlines.
+std::unordered_map<std::string,Problem> problems;
+// The number of the pending update of the notification or zero.
+std::uint64_t pendingUpdate = 0;
+std::uint64_t lastUpdate = 0;
+Clock::time_point lastShown;
 
-    auto whatChain = cu::getWhatChain( chain );
-    assert( !whatChain.empty() );
+// Composes the notification, so the gui thread only needs to show it.
+// It is destroyed together with the application.
+std::mutex reporterMutex;
+LoopThread * reporter = nullptr;
 
+// Only accessed by the gui thread.
+QPointer<QMessageBox> messageBox;
+std::vector<std::string> shownProblems;
+
+void composeMessage( std::vector<std::string> whatChain, Problem & problem )
+{
     whatChain.erase( std::remove(
             begin(whatChain), end(whatChain), "" )
         , end(whatChain) );
@@ -49,14 +95,272 @@ void handleException()
             reasons.pop_back();
         }
     }
+    problem.mainMessage = QString::fromStdString( mainMessage );
+    problem.reasons = QString::fromStdString( reasons );
+}
+
+std::string composeSummary( std::uint64_t nOccurrences, Clock::duration duration )
+{
+    const auto tenths = std::chrono::duration_cast<
+            std::chrono::duration<long long,std::deci>>( duration ).count();
+    return "The same problem occurred " +
+            std::to_string( nOccurrences ) + " times in " +
+            std::to_string( tenths / 10 ) + "." +
+            std::to_string( tenths % 10 ) + " s.";
+}
+
+void forgetLeastRecentProblem()
+{
+    const auto pos = std::min_element( problems.begin(), problems.end(),
+        []( const auto & lhs, const auto & rhs )
+        {
+            return lhs.second.last < rhs.second.last;
+        } );
+    if ( pos != problems.end() )
+        problems.erase( pos );
+}
+
+// Runs @c f in the reporter thread after @c delay. Returns false, if
+// there is no application.
+template <typename F>
+bool postToReporter( Clock::duration delay, F && f )
+{
+    std::lock_guard<std::mutex> lock( reporterMutex );
+    if ( !reporter )
+    {
+        const auto app = QCoreApplication::instance();
+        if ( !app )
+            return false;
+        LoopThreadOptions options;
+        options.name = "qu-exceptions";
+        reporter = new LoopThread( options );
+        QObject::connect( app, &QObject::destroyed, []()
+        {
+            // The reporter may be waiting for the mutex itself.
+            std::unique_lock<std::mutex> lock( reporterMutex );
+            const auto thread = std::exchange( reporter, nullptr );
+            lock.unlock();
+            delete thread;
+        } );
+    }
+    if ( delay > Clock::duration::zero() )
+        invokeInThreadAfter( reporter, delay, std::forward<F>(f) );
+    else
+        postToThread( reporter, std::forward<F>(f) );
+    return true;
+}
+
+// Shows or updates the notification. Called in the gui thread.
+void showNotification( const QString & text
+                     , const QString & informativeText
+                     , std::vector<std::string> keys )
+{
+    if ( !messageBox )
+    {
+        // The user may have closed the notification since it has been
+        // composed.
+        std::unique_lock<std::mutex> lock( problemsMutex );
+        if ( std::none_of( keys.begin(), keys.end(),
+                [&]( const std::string & key )
+                {
+                    const auto pos = problems.find( key );
+                    return pos != problems.end() && !pos->second.isDismissed;
+                } ) )
+            return;
+        lock.unlock();
+
+        const auto box = new QMessageBox;
+        box->setAttribute( Qt::WA_DeleteOnClose );
+        box->setWindowModality( Qt::NonModal );
+        QObject::connect( box, &QMessageBox::finished, []()
+        {
+            std::lock_guard<std::mutex> lock( problemsMutex );
+            for ( const auto & key : shownProblems )
+            {
+                const auto pos = problems.find( key );
+                if ( pos != problems.end() )
+                    pos->second.isDismissed = true;
+            }
+        } );
+        messageBox = box;
+    }
+    shownProblems = std::move(keys);
+    messageBox->setText( text );
+    messageBox->setInformativeText( informativeText );
+    messageBox->show();
+}
+
+// Composes the notification and passes it to the gui thread. If the task
+// is dropped without being run, then the next occurrence of a problem
+// schedules a new update.
+class UpdateTask
+{
+public:
+    explicit UpdateTask( std::uint64_t number )
+        : number( number )
+    {
+    }
+
+    UpdateTask( UpdateTask && other ) noexcept
+        : number( std::exchange( other.number, 0 ) )
+    {
+    }
+
+    ~UpdateTask()
+    {
+        if ( !number )
+            return;
+        std::lock_guard<std::mutex> lock( problemsMutex );
+        if ( pendingUpdate == number )
+            pendingUpdate = 0;
+    }
+
+    void operator()()
+    {
+        struct Listed
+        {
+            std::string key;
+            QString mainMessage;
+            QString reasons;
+            std::uint64_t nOccurrences;
+            Clock::time_point first;
+            Clock::time_point last;
+        };
+        std::vector<Listed> listed;
+        {
+            std::lock_guard<std::mutex> lock( problemsMutex );
+            if ( pendingUpdate == std::exchange( number, 0 ) )
+                pendingUpdate = 0;
+            const auto now = Clock::now();
+            lastShown = now;
+            for ( const auto & entry : problems )
+            {
+                const auto & problem = entry.second;
+                if ( problem.nOccurrences > 0 && !problem.isDismissed &&
+                     now - problem.last <= stormTimeout )
+                    listed.push_back( Listed{ entry.first
+                        , problem.mainMessage, problem.reasons
+                        , problem.nOccurrences, problem.first, problem.last } );
+            }
+        }
+        if ( listed.empty() )
+            return;
+
+        // The most recent problems come first.
+        std::sort( listed.begin(), listed.end(),
+            []( const Listed & lhs, const Listed & rhs )
+            {
+                return lhs.last > rhs.last;
+            } );
+        // Closing the notification dismisses the unlisted problems, too.
+        std::vector<std::string> keys;
+        for ( auto & problem : listed )
+            keys.push_back( std::move(problem.key) );
+        const auto nUnlisted = listed.size() -
+                std::min( listed.size(), maxListedProblems );
+        listed.resize( listed.size() - nUnlisted );
+
+        QString informativeText;
+        for ( const auto & problem : listed )
+        {
+            // With several problems, the main messages are not shown.
+            auto description = problem.reasons;
+            if ( listed.size() > 1 && description.isEmpty() )
+                description = problem.mainMessage;
+            if ( problem.nOccurrences > 1 )
+                description += ( description.isEmpty() ? "" : "\n" ) +
+                        QString::fromStdString( composeSummary(
+                            problem.nOccurrences, problem.last - problem.first ) );
+            if ( !informativeText.isEmpty() )
+                informativeText += "\n\n";
+            informativeText += description;
+        }
+        if ( nUnlisted > 0 )
+            informativeText += QString::fromStdString(
+                    "\n\n" + std::to_string( nUnlisted ) +
+                    " more problems occurred." );
+        const auto text = listed.size() == 1 && nUnlisted == 0
+                ? listed.front().mainMessage
+                : QString( "Several problems occurred:" );
+
+        if ( !QCoreApplication::instance() )
+            return;
+        postToGuiThread( [text, informativeText, keys = std::move(keys)]() mutable
+        {
+            showNotification( text, informativeText, std::move(keys) );
+        } );
+    }
+
+private:
+    std::uint64_t number;
+};
+
+void report( const std::exception_ptr & p )
+{
+    const auto chain = cu::getExceptionChain( p );
+
+    if ( cu::hasUserCancelledException(chain) )
+        return;
 
-    invokeInGuiThread( [=]()
+    auto whatChain = cu::getWhatChain( chain );
+    assert( !whatChain.empty() );
+
+    std::string key;
+    for ( const auto & what : whatChain )
+        key += what + '\n';
+
+    const auto now = Clock::now();
+    std::unique_lock<std::mutex> lock( problemsMutex );
+    auto pos = problems.find( key );
+    if ( pos == problems.end() )
     {
-        QMessageBox msgBox;
-        msgBox.setText( QString::fromStdString( mainMessage ) );
-        msgBox.setInformativeText( QString::fromStdString( reasons ) );
-        msgBox.exec();
-    } );
+        lock.unlock();
+        Problem problem;
+        composeMessage( std::move(whatChain), problem );
+        lock.lock();
+        pos = problems.find( key );
+        if ( pos == problems.end() )
+        {
+            if ( problems.size() >= maxProblems )
+                forgetLeastRecentProblem();
+            pos = problems.emplace( std::move(key), std::move(problem) ).first;
+        }
+    }
+    auto & problem = pos->second;
+    if ( problem.nOccurrences > 0 && now - problem.last > stormTimeout )
+    {
+        problem.nOccurrences = 0;
+        problem.isDismissed = false;
+    }
+    if ( problem.nOccurrences++ == 0 )
+        problem.first = now;
+    problem.last = now;
+    if ( problem.isDismissed || pendingUpdate != 0 )
+        return;
+
+    // At most one update is pending, and it is delayed such that updates
+    // are at least minUpdateInterval apart.
+    const auto number = pendingUpdate = ++lastUpdate;
+    const auto delay = lastShown + minUpdateInterval - now;
+    lock.unlock();
+    postToReporter( delay, UpdateTask( number ) );
+}
+
+} // unnamed namespace
+
+
+void handleException()
+{
+    auto p = std::current_exception();
+    assert( p != std::exception_ptr() );
+
+    // During a storm even composing the messages would block the gui
+    // thread, so it only passes the exception on.
+    const auto app = QCoreApplication::instance();
+    if ( app && QThread::currentThread() == app->thread() &&
+         postToReporter( Clock::duration::zero(), [p]{ report( p ); } ) )
+        return;
+    report( p );
 }
 
 }
@@ -10,6 +10,20 @@ namespace qu {
 #define QU_HANDLE_ALL_EXCEPTIONS_FROM \
     ::qu::exception_detail::ExceptionHandlerImpl() += [&]
 
+/// @brief Reports the exception currently being handled to the user.
+///
+/// Must be called from a catch block. All problems are reported in a
+/// single non-modal message box. Exceptions with the same chain of
+/// @c what() messages count as the same problem: while it keeps occurring,
+/// the message box states how often it occurred in which time. If several
+/// problems occur, then the most recent ones are listed. The message box
+/// is updated at most twice per second. If the user closes it, then the
+/// problems listed in it are not shown again until they have not occurred
+/// for ten seconds.
+///
+/// The messages are composed in the calling thread, or in a reporting
+/// thread, if this function is called in the gui thread. So the gui thread
+/// only shows the message box.
 void handleException();
 
 namespace exception_detail
@@ -0,0 +1,373 @@
+/// @file
+///
+/// @brief Future and promise types whose results can be consumed by
+///     continuations in the event loop of a @c QThread.
+
+#pragma once
+
+#include "thread_dispatcher.h"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+class QThread;
+
+namespace qu
+{
+
+template <typename T>
+class Future;
+
+template <typename T>
+class Promise;
+
+namespace detail
+{
+
+    template <typename T>
+    class FutureAwaiter;
+
+    template <typename T>
+    struct FutureStorage { using type = T; };
+
+    template <typename T>
+    struct FutureStorage<T&> { using type = std::reference_wrapper<T>; };
+
+    template <>
+    struct FutureStorage<void> { using type = std::monostate; };
+
+
+    /// @brief The state shared between a @c Promise and a @c Future.
+    ///
+    /// At most one continuation can be attached. It is posted to the
+    /// dispatcher of its thread as soon as the state becomes ready.
+    template <typename T>
+    class FutureState
+    {
+    public:
+        ~FutureState()
+        {
+            delete continuation;
+        }
+
+        template <typename...Args>
+        void setValue( Args&&...args )
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            throwIfReady();
+            value.emplace( std::forward<Args>(args)... );
+            makeReady( std::move(lock) );
+        }
+
+        void setException( std::exception_ptr e )
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            throwIfReady();
+            exception = std::move(e);
+            makeReady( std::move(lock) );
+        }
+
+        bool isReady() const
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            return ready;
+        }
+
+        void wait() const
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            cv.wait( lock, [this]{ return ready; } );
+        }
+
+        /// Waits for the result and moves it out or rethrows the exception.
+        T take()
+        {
+            wait();
+            if ( exception )
+                std::rethrow_exception( exception );
+            if constexpr ( !std::is_void<T>::value )
+                return std::move(*value);
+        }
+
+        /// Takes ownership of @c task and posts it to @c thread, when the
+        /// state is ready.
+        void setContinuation( QThread * thread, DispatchTask * task )
+        {
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+                if ( !ready )
+                {
+                    continuationThread = thread;
+                    continuation = task;
+                    return;
+                }
+            }
+            ThreadDispatcher::forThread( thread ).post( task );
+        }
+
+    private:
+        void throwIfReady() const
+        {
+            if ( ready )
+                throw std::future_error(
+                        std::future_errc::promise_already_satisfied );
+        }
+
+        void makeReady( std::unique_lock<std::mutex> lock )
+        {
+            ready = true;
+            const auto thread = continuationThread;
+            const auto task = std::exchange( continuation, nullptr );
+            lock.unlock();
+            cv.notify_all();
+            if ( task )
+                ThreadDispatcher::forThread( thread ).post( task );
+        }
+
+        mutable std::mutex mutex;
+        mutable std::condition_variable cv;
+        bool ready = false;
+        std::optional<typename FutureStorage<T>::type> value;
+        std::exception_ptr exception;
+        QThread * continuationThread = nullptr;
+        DispatchTask * continuation = nullptr;
+    };
+
+
+    /// Calls @c f with @c args and stores the result or the thrown
+    /// exception in @c promise.
+    template <typename T, typename F, typename...Args>
+    void fulfil( Promise<T> & promise, F & f, Args&&...args )
+    {
+        try
+        {
+            if constexpr ( std::is_void<T>::value )
+            {
+                f( std::forward<Args>(args)... );
+                promise.setValue();
+            }
+            else
+                promise.setValue( f( std::forward<Args>(args)... ) );
+        }
+        catch ( ... )
+        {
+            promise.setException( std::current_exception() );
+        }
+    }
+
+
+    template <typename F, typename T>
+    struct ContinuationResult
+    {
+        using type = std::invoke_result_t<F&,T>;
+    };
+
+    template <typename F>
+    struct ContinuationResult<F,void>
+    {
+        using type = std::invoke_result_t<F&>;
+    };
+
+} // namespace detail
+
+
+/// @brief The producing side of a @c Future.
+///
+/// If a promise is destroyed before a result has been set, then
+/// the future receives a @c std::future_error with the error code
+/// @c std::future_errc::broken_promise.
+template <typename T>
+class Promise
+{
+public:
+    Promise()
+        : state( std::make_shared<detail::FutureState<T>>() )
+    {
+    }
+
+    Promise( Promise && ) noexcept = default;
+
+    Promise & operator=( Promise && other ) noexcept
+    {
+        Promise( std::move(other) ).swap( *this );
+        return *this;
+    }
+
+    ~Promise()
+    {
+        if ( state && !state->isReady() )
+            state->setException( std::make_exception_ptr( std::future_error(
+                    std::future_errc::broken_promise ) ) );
+    }
+
+    void swap( Promise & other ) noexcept
+    {
+        state.swap( other.state );
+    }
+
+    /// May only be called once.
+    Future<T> getFuture()
+    {
+        if ( futureRetrieved )
+            throw std::future_error(
+                    std::future_errc::future_already_retrieved );
+        futureRetrieved = true;
+        return Future<T>( state );
+    }
+
+    template <typename...Args>
+    void setValue( Args&&...args )
+    {
+        state->setValue( std::forward<Args>(args)... );
+    }
+
+    void setException( std::exception_ptr e )
+    {
+        state->setException( std::move(e) );
+    }
+
+private:
+    std::shared_ptr<detail::FutureState<T>> state;
+    bool futureRetrieved = false;
+};
+
+
+namespace detail
+{
+
+    /// @brief A queued functor that fulfils a promise.
+    ///
+    /// When run, @c f is called with the promise. When the task is
+    /// abandoned instead, the given reason is stored in the promise.
+    template <typename T, typename F>
+    struct PromiseTask
+    {
+        void operator()()
+        {
+            f( promise );
+        }
+
+        void abandon( std::exception_ptr reason )
+        {
+            promise.setException( std::move(reason) );
+        }
+
+        Promise<T> promise;
+        F f;
+    };
+
+    template <typename T, typename F>
+    PromiseTask<T,std::decay_t<F>> makePromiseTask( Promise<T> promise, F && f )
+    {
+        return { std::move(promise), std::forward<F>(f) };
+    }
+
+} // namespace detail
+
+
+/// @brief The consuming side of an asynchroneous result.
+///
+/// Besides blocking on the result with @c get() just like with a
+/// @c std::future, a continuation can be attached with @c then(). The
+/// continuation is run in the event loop of a chosen thread as soon as
+/// the result is ready, so no thread needs to wait for it.
+template <typename T>
+class Future
+{
+public:
+    Future() = default;
+
+    /// Returns whether the future refers to a shared state.
+    bool valid() const noexcept
+    {
+        return state != nullptr;
+    }
+
+    /// Returns whether a value or an exception has been set.
+    bool isReady() const
+    {
+        return state->isReady();
+    }
+
+    /// Blocks until the result is ready.
+    void wait() const
+    {
+        state->wait();
+    }
+
+    /// @brief Blocks until the result is ready and returns it.
+    ///
+    /// If an exception has been stored, then it is rethrown. Afterwards
+    /// the future is not valid anymore.
+    T get()
+    {
+        const auto movedState = std::move(state);
+        return movedState->take();
+    }
+
+    /// @brief Calls @c f with the result in the event loop of @c thread.
+    ///
+    /// The continuation @c f is called with the value of this future
+    /// (or without arguments for @c Future<void>) as soon as it is ready.
+    /// The result of @c f is provided by the returned future. If this
+    /// future holds an exception, then @c f is not called and the
+    /// exception is passed on to the returned future. Continuations are
+    /// always queued, even if the result is ready already or @c thread
+    /// is the current thread. Afterwards this future is not valid anymore.
+    template <typename F>
+    auto then( QThread * thread, F && f )
+        -> Future<typename detail::ContinuationResult<F,T>::type>
+    {
+        using R = typename detail::ContinuationResult<F,T>::type;
+        Promise<R> promise;
+        auto result = promise.getFuture();
+        const auto source = state.get();
+        source->setContinuation( thread, new detail::DispatchTask(
+            detail::makePromiseTask( std::move(promise),
+            [self = std::move(*this), f = std::forward<F>(f)](
+                Promise<R> & promise ) mutable
+            {
+                std::exception_ptr exception;
+                if constexpr ( std::is_void<T>::value )
+                {
+                    try { self.get(); }
+                    catch ( ... ) { exception = std::current_exception(); }
+                    if ( !exception )
+                        detail::fulfil( promise, f );
+                }
+                else
+                {
+                    std::optional<typename detail::FutureStorage<T>::type> value;
+                    try { value.emplace( self.get() ); }
+                    catch ( ... ) { exception = std::current_exception(); }
+                    if ( !exception )
+                        detail::fulfil( promise, f,
+                                        static_cast<T&&>( *value ) );
+                }
+                if ( exception )
+                    promise.setException( std::move(exception) );
+            } ) ) );
+        return result;
+    }
+
+private:
+    friend class Promise<T>;
+    friend class detail::FutureAwaiter<T>;
+
+    explicit Future( std::shared_ptr<detail::FutureState<T>> state )
+        : state( std::move(state) )
+    {
+    }
+
+    std::shared_ptr<detail::FutureState<T>> state;
+};
+
+} // namespace qu
@@ -0,0 +1,117 @@
+#include "graphics_item_delegates.h"
+
+#include <QGraphicsScene>
+#include <QThread>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+namespace qu {
+
+namespace { // unnamed
+
+// The number of existing registries. Items of scenes without a registry
+// only need to load it.
+std::atomic<int> nRegistries{ 0 };
+// Changed whenever a registry is created or destroyed.
+std::atomic<std::uint64_t> registryGeneration{ 0 };
+
+// The result of the last lookup of this thread. Consecutive events mostly
+// go to items of the same scene.
+struct LastLookup
+{
+    const QGraphicsScene * scene = nullptr;
+    GraphicsItemDelegates * delegates = nullptr;
+    std::uint64_t generation = 0;
+};
+
+thread_local LastLookup lastLookup;
+
+} // unnamed namespace
+
+
+GraphicsItemDelegates::GraphicsItemDelegates( QGraphicsScene * scene )
+    : QObject( scene )
+{
+    ++nRegistries;
+    ++registryGeneration;
+}
+
+
+GraphicsItemDelegates::~GraphicsItemDelegates()
+{
+    --nRegistries;
+    ++registryGeneration;
+}
+
+
+GraphicsItemDelegates & GraphicsItemDelegates::forScene( QGraphicsScene * scene )
+{
+    assert( scene );
+    if ( const auto delegates = find( scene ) )
+        return *delegates;
+    return *new GraphicsItemDelegates( scene );
+}
+
+
+GraphicsItemDelegates * GraphicsItemDelegates::find( const QGraphicsScene * scene )
+{
+    // Called for every event of an item without a handler of its own. The
+    // registry is a child of the scene rather than an entry of a global
+    // map, so scenes of different threads share no state, except for the
+    // counters.
+    if ( !scene || nRegistries.load( std::memory_order_relaxed ) == 0 )
+        return nullptr;
+    auto & last = lastLookup;
+    const auto generation = registryGeneration.load( std::memory_order_relaxed );
+    if ( last.scene == scene && last.generation == generation )
+        return last.delegates;
+    assert( scene->thread() == QThread::currentThread() );
+    last.scene = scene;
+    last.delegates = scene->findChild<GraphicsItemDelegates*>(
+                QString(), Qt::FindDirectChildrenOnly );
+    last.generation = generation;
+    return last.delegates;
+}
+
+
+void GraphicsItemDelegates::removeHandlers( int category )
+{
+    const auto pos = categories.find( category );
+    if ( pos == categories.end() )
+        return;
+    if ( dispatchDepth > 0 )
+        retired.push_back( categories.extract( pos ) );
+    else
+        categories.erase( pos );
+    updateEventMask();
+}
+
+
+void GraphicsItemDelegates::clear()
+{
+    while ( dispatchDepth > 0 && !categories.empty() )
+        retired.push_back( categories.extract( categories.begin() ) );
+    categories.clear();
+    updateEventMask();
+}
+
+
+void GraphicsItemDelegates::updateEventMask()
+{
+    // Handlers are rarely set, so recomputing the mask is fine.
+    eventMask = 0;
+    for ( const auto & category : categories )
+    {
+#define ADD_EVENT_BIT( EventName, eventName, EventType ) \
+        if ( category.second.eventName ) \
+            eventMask |= std::uint32_t(1) << EventName##Index;
+
+        QU_FOR_EACH_GRAPHICS_ITEM_EVENT( ADD_EVENT_BIT )
+
+#undef ADD_EVENT_BIT
+    }
+}
+
+} // namespace qu
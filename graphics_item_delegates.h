@@ -0,0 +1,187 @@
+/// @file
+///
+/// @brief Event handlers shared by the graphics items of a scene, registered
+///     per item category.
+
+#pragma once
+
+#include <QGraphicsItem>
+#include <QObject>
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class QGraphicsScene;
+
+/// Calls @c X(EventName,eventName,EventType) for each event handler of
+/// @c QGraphicsItem that can be customized.
+#define QU_FOR_EACH_GRAPHICS_ITEM_EVENT( X ) \
+    X( DragEnterEvent       , dragEnterEvent       , QGraphicsSceneDragDropEvent ) \
+    X( DragLeaveEvent       , dragLeaveEvent       , QGraphicsSceneDragDropEvent ) \
+    X( DragMoveEvent        , dragMoveEvent        , QGraphicsSceneDragDropEvent ) \
+    X( DropEvent            , dropEvent            , QGraphicsSceneDragDropEvent ) \
+    X( FocusInEvent         , focusInEvent         , QFocusEvent                 ) \
+    X( FocusOutEvent        , focusOutEvent        , QFocusEvent                 ) \
+    X( HoverEnterEvent      , hoverEnterEvent      , QGraphicsSceneHoverEvent    ) \
+    X( HoverLeaveEvent      , hoverLeaveEvent      , QGraphicsSceneHoverEvent    ) \
+    X( HoverMoveEvent       , hoverMoveEvent       , QGraphicsSceneHoverEvent    ) \
+    X( InputMethodEvent     , inputMethodEvent     , QInputMethodEvent           ) \
+    X( KeyPressEvent        , keyPressEvent        , QKeyEvent                   ) \
+    X( KeyReleaseEvent      , keyReleaseEvent      , QKeyEvent                   ) \
+    X( MouseDoubleClickEvent, mouseDoubleClickEvent, QGraphicsSceneMouseEvent    ) \
+    X( MouseMoveEvent       , mouseMoveEvent       , QGraphicsSceneMouseEvent    ) \
+    X( MousePressEvent      , mousePressEvent      , QGraphicsSceneMouseEvent    ) \
+    X( MouseReleaseEvent    , mouseReleaseEvent    , QGraphicsSceneMouseEvent    ) \
+    X( WheelEvent           , wheelEvent           , QGraphicsSceneWheelEvent    )
+
+namespace qu
+{
+
+/// @brief A registry of event handlers of the items of a scene, keyed by
+/// item category.
+///
+/// An @c EventHandlingGraphicsItem without a handler of its own for an
+/// event looks up the handler of its category in the registry of its
+/// scene. The category of an item is its @c type(), unless it has been
+/// set with @c setHandlerCategory(). So switching the interaction mode
+/// of many items, e.g. from selecting to panning, takes a single update
+/// of the registry instead of setting handlers on every item.
+///
+/// Handlers take the item and the event and return whether they have
+/// handled the event. If they return false, the handler of the item class
+/// is called. Handlers may set and remove handlers, including themselves.
+///
+/// The registry of a scene is a child of the scene and must only be used
+/// in the thread of the scene. The items of a scene only look it up while
+/// handling events, which happens in that thread, too.
+class GraphicsItemDelegates
+    : public QObject
+{
+    Q_OBJECT
+public:
+    template <typename EventType>
+    using Handler = std::function<bool(QGraphicsItem*,EventType*)>;
+
+    virtual ~GraphicsItemDelegates();
+
+    /// Returns the registry of @c scene. It is created on first use.
+    static GraphicsItemDelegates & forScene( QGraphicsScene * scene );
+
+    /// Returns the registry of @c scene, or null, if it has none.
+    static GraphicsItemDelegates * find( const QGraphicsScene * scene );
+
+    /// Removes all handlers of @c category.
+    void removeHandlers( int category );
+
+    /// Removes all handlers.
+    void clear();
+
+private:
+    explicit GraphicsItemDelegates( QGraphicsScene * scene );
+
+    enum EventIndex
+    {
+#define DECLARE_EVENT_INDEX( EventName, eventName, EventType ) \
+        EventName##Index,
+
+        QU_FOR_EACH_GRAPHICS_ITEM_EVENT( DECLARE_EVENT_INDEX )
+
+#undef DECLARE_EVENT_INDEX
+    };
+
+    struct Handlers
+    {
+#define DECLARE_EVENT_HANDLER( EventName, eventName, EventType ) \
+        Handler<EventType> eventName;
+
+        QU_FOR_EACH_GRAPHICS_ITEM_EVENT( DECLARE_EVENT_HANDLER )
+
+#undef DECLARE_EVENT_HANDLER
+    };
+
+    using CategoryMap = std::unordered_map<int,Handlers>;
+
+    template <typename EventType, typename F>
+    void setHandler( int category
+                   , Handler<EventType> Handlers::* handler
+                   , F && f )
+    {
+        auto pos = categories.find( category );
+        if ( pos == categories.end() )
+            pos = categories.emplace( category, Handlers() ).first;
+        else if ( dispatchDepth > 0 )
+        {
+            // A running handler must neither be destroyed nor moved, so
+            // the handlers of the category are replaced by a copy.
+            auto copy = pos->second;
+            retired.push_back( categories.extract( pos ) );
+            pos = categories.emplace( category, std::move(copy) ).first;
+        }
+        pos->second.*handler = std::forward<F>(f);
+        updateEventMask();
+    }
+
+    template <typename EventType>
+    bool handle( QGraphicsItem * item
+               , int category
+               , EventIndex index
+               , Handler<EventType> Handlers::* handler
+               , EventType * event )
+    {
+        if ( !( eventMask & ( std::uint32_t(1) << index ) ) )
+            return false;
+        const auto pos = categories.find( category );
+        if ( pos == categories.end() || !( pos->second.*handler ) )
+            return false;
+
+        struct Guard
+        {
+            ~Guard()
+            {
+                if ( --self->dispatchDepth == 0 )
+                    self->retired.clear();
+            }
+            GraphicsItemDelegates * self;
+        } guard{ this };
+        ++dispatchDepth;
+        return ( pos->second.*handler )( item, event );
+    }
+
+    void updateEventMask();
+
+    // The map is node based, so handlers are not moved while they run.
+    CategoryMap categories;
+    // Bit i is set, if a handler for the event with index i exists.
+    std::uint32_t eventMask = 0;
+    // Handlers replaced or removed while handlers are running are kept
+    // alive until all of them have returned.
+    int dispatchDepth = 0;
+    std::vector<CategoryMap::node_type> retired;
+
+#define IMPLEMENT_EVENT_HANDLER( EventName, eventName, EventType ) \
+public: \
+    /** Sets the handler of the items of @c category. An empty handler */ \
+    /** removes it. */ \
+    template <typename F> \
+    void set##EventName##Handler( int category, F && f ) \
+    { \
+        setHandler( category, &Handlers::eventName, std::forward<F>(f) ); \
+    } \
+\
+    /** Calls the handler of @c category and returns whether it has */ \
+    /** handled the event. */ \
+    bool handle##EventName( QGraphicsItem * item, int category, EventType * event ) \
+    { \
+        return handle( item, category, EventName##Index, \
+                       &Handlers::eventName, event ); \
+    }
+
+    QU_FOR_EACH_GRAPHICS_ITEM_EVENT( IMPLEMENT_EVENT_HANDLER )
+
+#undef IMPLEMENT_EVENT_HANDLER
+};
+
+} // namespace qu
@@ -37,7 +37,7 @@ public:
     ~ProgressWidgetProgress()
     {
         const auto movedWidget = std::move(widget);
-        qu::invokeInGuiThread( [movedWidget]()
+        qu::postToGuiThread( [movedWidget]()
         {
             (*movedWidget)( [](ProgressWidget *& ptr )
             {
@@ -0,0 +1,281 @@
+#include "input_coalescing_filter.h"
+
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <QMouseEvent>
+#include <QResizeEvent>
+#include <QScreen>
+#include <QTimerEvent>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <cmath>
+
+namespace qu {
+
+namespace { // unnamed
+
+// Returns a copy of @c event, which is an @c EventType.
+template <typename EventType>
+std::unique_ptr<QEvent> copyEvent( const QEvent & event )
+{
+#if QT_VERSION >= QT_VERSION_CHECK( 6, 0, 0 )
+    // The copy constructors of events are protected in Qt 6.
+    return std::unique_ptr<QEvent>( event.clone() );
+#else
+    return std::make_unique<EventType>( static_cast<const EventType&>( event ) );
+#endif
+}
+
+// Returns a copy of @c event, if its type is held back, and null
+// otherwise.
+std::unique_ptr<QEvent> copyCompressible( const QEvent * event )
+{
+    switch ( event->type() )
+    {
+    case QEvent::MouseMove:
+        return copyEvent<QMouseEvent>( *event );
+    case QEvent::HoverMove:
+        return copyEvent<QHoverEvent>( *event );
+    case QEvent::Wheel:
+        return copyEvent<QWheelEvent>( *event );
+    case QEvent::Resize:
+        return copyEvent<QResizeEvent>( *event );
+    default:
+        return nullptr;
+    }
+}
+
+// Merges @c next into @c held, which has the same type. Returns false,
+// if the events must not be merged.
+bool merge( std::unique_ptr<QEvent> & held, const QEvent * next )
+{
+    switch ( next->type() )
+    {
+    case QEvent::MouseMove:
+    {
+        const auto & first = static_cast<const QMouseEvent&>( *held );
+        const auto & last = static_cast<const QMouseEvent&>( *next );
+        if ( first.buttons() != last.buttons() ||
+             first.modifiers() != last.modifiers() )
+            return false;
+        held = copyEvent<QMouseEvent>( last );
+        return true;
+    }
+    case QEvent::HoverMove:
+    {
+        const auto & first = static_cast<const QHoverEvent&>( *held );
+        const auto & last = static_cast<const QHoverEvent&>( *next );
+        if ( first.modifiers() != last.modifiers() )
+            return false;
+#if QT_VERSION >= QT_VERSION_CHECK( 6, 3, 0 )
+        held = std::make_unique<QHoverEvent>(
+                    QEvent::HoverMove, last.position(), last.globalPosition(),
+                    first.oldPosF(), last.modifiers(), last.pointingDevice() );
+#else
+        held = std::make_unique<QHoverEvent>(
+                    QEvent::HoverMove, last.posF(), first.oldPosF(),
+                    last.modifiers() );
+#endif
+        return true;
+    }
+    case QEvent::Wheel:
+    {
+        const auto & first = static_cast<const QWheelEvent&>( *held );
+        const auto & last = static_cast<const QWheelEvent&>( *next );
+        if ( first.buttons() != last.buttons() ||
+             first.modifiers() != last.modifiers() ||
+             first.phase() != last.phase() ||
+             first.inverted() != last.inverted() ||
+             first.source() != last.source() )
+            return false;
+        held = std::make_unique<QWheelEvent>(
+                    last.position(), last.globalPosition(),
+                    first.pixelDelta() + last.pixelDelta(),
+                    first.angleDelta() + last.angleDelta(),
+                    last.buttons(), last.modifiers(), last.phase(),
+                    last.inverted(), last.source()
+#if QT_VERSION >= QT_VERSION_CHECK( 6, 0, 0 )
+                    , last.pointingDevice()
+#endif
+                    );
+        return true;
+    }
+    case QEvent::Resize:
+    {
+        const auto & first = static_cast<const QResizeEvent&>( *held );
+        const auto & last = static_cast<const QResizeEvent&>( *next );
+        held = std::make_unique<QResizeEvent>( last.size(), first.oldSize() );
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Returns whether events of @c type must not overtake held events.
+bool isBarrier( QEvent::Type type )
+{
+    switch ( type )
+    {
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease:
+    case QEvent::Enter:
+    case QEvent::Leave:
+    case QEvent::HoverEnter:
+    case QEvent::HoverLeave:
+    case QEvent::FocusIn:
+    case QEvent::FocusOut:
+    case QEvent::ContextMenu:
+    case QEvent::TouchBegin:
+    case QEvent::TouchUpdate:
+    case QEvent::TouchEnd:
+    case QEvent::TouchCancel:
+    case QEvent::TabletPress:
+    case QEvent::TabletMove:
+    case QEvent::TabletRelease:
+    case QEvent::DragEnter:
+    case QEvent::DragMove:
+    case QEvent::DragLeave:
+    case QEvent::Drop:
+    case QEvent::Hide:
+    case QEvent::Close:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // unnamed namespace
+
+
+InputCoalescingFilter::InputCoalescingFilter(
+        std::chrono::milliseconds interval, QObject * parent )
+    : QObject( parent )
+    , interval( std::max( interval, std::chrono::milliseconds( 0 ) ) )
+{
+}
+
+
+InputCoalescingFilter::~InputCoalescingFilter() = default;
+
+
+InputCoalescingFilter * InputCoalescingFilter::install(
+        QObject * target, std::chrono::milliseconds interval )
+{
+    const auto filter = new InputCoalescingFilter( interval, target );
+    target->installEventFilter( filter );
+    return filter;
+}
+
+
+std::chrono::milliseconds InputCoalescingFilter::frameInterval()
+{
+    const auto fallback = std::chrono::milliseconds( 16 );
+    if ( !qobject_cast<QGuiApplication*>( QCoreApplication::instance() ) )
+        return fallback;
+    const auto screen = QGuiApplication::primaryScreen();
+    if ( !screen || !( screen->refreshRate() > 0 ) )
+        return fallback;
+    return std::chrono::milliseconds( std::max(
+                1L, std::lround( 1000 / screen->refreshRate() ) ) );
+}
+
+
+void InputCoalescingFilter::flush()
+{
+    if ( timerId )
+    {
+        killTimer( timerId );
+        timerId = 0;
+    }
+    // Events held while delivering are delivered by the next flush.
+    const auto delivered = std::move(heldEvents);
+    heldEvents.clear();
+
+    struct Guard
+    {
+        ~Guard()
+        {
+            self->isDelivering = false;
+        }
+        InputCoalescingFilter * self;
+    } guard{ this };
+    isDelivering = true;
+    for ( const auto & held : delivered )
+    {
+        if ( !held.receiver )
+            continue;
+        ++nDelivered;
+        QCoreApplication::sendEvent( held.receiver, held.event.get() );
+    }
+}
+
+
+std::uint64_t InputCoalescingFilter::heldEventCount() const
+{
+    return nHeld;
+}
+
+
+std::uint64_t InputCoalescingFilter::deliveredEventCount() const
+{
+    return nDelivered;
+}
+
+
+bool InputCoalescingFilter::eventFilter( QObject * receiver, QEvent * event )
+{
+    if ( isDelivering )
+        return false;
+    if ( isBarrier( event->type() ) )
+    {
+        if ( !heldEvents.empty() )
+            flush();
+        return false;
+    }
+    return hold( receiver, event );
+}
+
+
+void InputCoalescingFilter::timerEvent( QTimerEvent * event )
+{
+    if ( event->timerId() == timerId )
+        flush();
+    else
+        QObject::timerEvent( event );
+}
+
+
+bool InputCoalescingFilter::hold( QObject * receiver, QEvent * event )
+{
+    const auto type = event->type();
+    const auto pos = std::find_if( heldEvents.begin(), heldEvents.end(),
+        [receiver,type]( const HeldEvent & held )
+        {
+            return held.receiver == receiver && held.event->type() == type;
+        } );
+    if ( pos != heldEvents.end() )
+    {
+        if ( merge( pos->event, event ) )
+        {
+            ++nHeld;
+            return true;
+        }
+        flush();
+    }
+
+    auto copy = copyCompressible( event );
+    if ( !copy )
+        return false;
+    heldEvents.push_back( HeldEvent{ receiver, std::move(copy) } );
+    ++nHeld;
+    if ( !timerId )
+        timerId = startTimer( int( interval.count() ), Qt::PreciseTimer );
+    return true;
+}
+
+} // namespace qu
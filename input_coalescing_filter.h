@@ -0,0 +1,95 @@
+/// @file
+///
+/// @brief An event filter that merges bursts of input events.
+
+#pragma once
+
+#include <QEvent>
+#include <QObject>
+#include <QPointer>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class QTimerEvent;
+
+namespace qu
+{
+
+/// @brief Holds back compressible input events and delivers one merged
+/// event per interval.
+///
+/// High-rate mice and touchpads deliver many more mouse move and wheel
+/// events than a view can repaint. This filter holds back events of the
+/// types @c QEvent::MouseMove, @c QEvent::HoverMove, @c QEvent::Wheel and
+/// @c QEvent::Resize. For each receiver and type only one event is kept:
+/// moves keep the latest position, hover moves and resizes keep the old
+/// position or size of the first held event, and wheel events sum their
+/// deltas. The held events are delivered when the interval has passed.
+///
+/// Before any other input event, such as a mouse button press or release,
+/// a key event or a focus change, is delivered, the held events are
+/// delivered, so the order relative to these events is preserved. Moves
+/// with different buttons or modifiers as well as wheel events of
+/// different scroll phases are not merged.
+///
+/// The filter should be installed on the objects whose handlers are
+/// expensive, e.g. on the viewport of a view. Merged events are sent with
+/// @c QCoreApplication::sendEvent() and are not spontaneous.
+class InputCoalescingFilter
+    : public QObject
+{
+    Q_OBJECT
+public:
+    explicit InputCoalescingFilter(
+            std::chrono::milliseconds interval = frameInterval()
+            , QObject * parent = nullptr );
+
+    virtual ~InputCoalescingFilter();
+
+    /// @brief Creates a filter and installs it on @c target.
+    ///
+    /// The filter is a child of @c target.
+    static InputCoalescingFilter * install(
+            QObject * target
+            , std::chrono::milliseconds interval = frameInterval() );
+
+    /// Returns the refresh period of the primary screen, or 16
+    /// milliseconds, if it is not known.
+    static std::chrono::milliseconds frameInterval();
+
+    /// Delivers all held events now.
+    void flush();
+
+    /// Returns the number of events held back and the number of merged
+    /// events delivered so far.
+    std::uint64_t heldEventCount() const;
+    std::uint64_t deliveredEventCount() const;
+
+    virtual bool eventFilter( QObject * receiver, QEvent * event ) override;
+
+protected:
+    virtual void timerEvent( QTimerEvent * event ) override;
+
+private:
+    struct HeldEvent
+    {
+        QPointer<QObject> receiver;
+        std::unique_ptr<QEvent> event;
+    };
+
+    bool hold( QObject * receiver, QEvent * event );
+
+    const std::chrono::milliseconds interval;
+    // Few receivers and types are held at a time, so a linear search is
+    // fast. Sorted by the arrival of the first held event.
+    std::vector<HeldEvent> heldEvents;
+    int timerId = 0;
+    bool isDelivering = false;
+    std::uint64_t nHeld = 0;
+    std::uint64_t nDelivered = 0;
+};
+
+} // namespace qu
@@ -0,0 +1,681 @@
+#include "instanced_graphics_item.h"
+
+#include <QGraphicsSceneDragDropEvent>
+#include <QGraphicsSceneHoverEvent>
+#include <QGraphicsSceneMouseEvent>
+#include <QPainter>
+#include <QPainterPath>
+#include <QStyleOptionGraphicsItem>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace qu {
+
+namespace { // unnamed
+
+// Elements are painted in batches of at most this many rectangles.
+const std::size_t maxBatchSize = 4096;
+
+// Ellipses smaller than this in device pixels are drawn as rectangles.
+const double minEllipseExtent = 2;
+
+} // unnamed namespace
+
+
+InstancedGraphicsItem::InstancedGraphicsItem( QGraphicsItem * parent )
+    : QGraphicsItem( parent )
+{
+    handlerSets.push_back( std::make_unique<Handlers>() );
+    // Makes the exposed rectangle available in paint().
+    setFlag( ItemUsesExtendedStyleOption );
+}
+
+
+InstancedGraphicsItem::~InstancedGraphicsItem() = default;
+
+
+void InstancedGraphicsItem::setElementShape( ElementShape shape )
+{
+    elementShape = shape;
+    update();
+}
+
+
+InstancedGraphicsItem::ElementShape InstancedGraphicsItem::getElementShape() const
+{
+    return elementShape;
+}
+
+
+void InstancedGraphicsItem::reserve( std::size_t nElements )
+{
+    centers.reserve( nElements );
+    sizes.reserve( nElements );
+    colors.reserve( nElements );
+    handlerIds.reserve( nElements );
+    isUnindexed.reserve( nElements );
+}
+
+
+InstancedGraphicsItem::ElementIndex InstancedGraphicsItem::addElement(
+        QPointF center, QSizeF size, const QColor & color, HandlerId handlerId )
+{
+    assert( handlerId < handlerSets.size() );
+    assert( centers.size() < std::numeric_limits<std::uint32_t>::max() );
+    const auto index = centers.size();
+    centers.push_back( center );
+    sizes.push_back( size );
+    colors.push_back( color.rgba() );
+    handlerIds.push_back( handlerId );
+    isUnindexed.push_back( false );
+    if ( isGridValid )
+        markUnindexed( index );
+    const auto rect = elementRect( index );
+    growBounds( rect );
+    update( rect );
+    return index;
+}
+
+
+void InstancedGraphicsItem::removeElement( ElementIndex index )
+{
+    assert( index < centers.size() );
+    update( elementRect( index ) );
+    const auto last = centers.size() - 1;
+    centers[index] = centers[last];
+    sizes[index] = sizes[last];
+    colors[index] = colors[last];
+    handlerIds[index] = handlerIds[last];
+    centers.pop_back();
+    sizes.pop_back();
+    colors.pop_back();
+    handlerIds.pop_back();
+    isUnindexed.pop_back();
+    // The grid entries of the last element are ignored from now on, since
+    // they are out of range. The grid entries at index are the ones of the
+    // removed element.
+    if ( isGridValid && index != last && !isUnindexed[index] )
+        markUnindexed( index );
+    retarget( grabbedElement, index, last );
+    retarget( hoveredElement, index, last );
+    retarget( draggedElement, index, last );
+}
+
+
+void InstancedGraphicsItem::clear()
+{
+    prepareGeometryChange();
+    centers.clear();
+    sizes.clear();
+    colors.clear();
+    handlerIds.clear();
+    isUnindexed.clear();
+    bounds = QRectF();
+    invalidateGrid();
+    grabbedElement = noElement;
+    hoveredElement = noElement;
+    draggedElement = noElement;
+}
+
+
+std::size_t InstancedGraphicsItem::elementCount() const
+{
+    return centers.size();
+}
+
+
+QPointF InstancedGraphicsItem::elementCenter( ElementIndex index ) const
+{
+    return centers.at( index );
+}
+
+
+void InstancedGraphicsItem::setElementCenter( ElementIndex index, QPointF center )
+{
+    const auto oldRect = elementRect( index );
+    centers[index] = center;
+    elementMoved( index, oldRect );
+}
+
+
+QSizeF InstancedGraphicsItem::elementSize( ElementIndex index ) const
+{
+    return sizes.at( index );
+}
+
+
+void InstancedGraphicsItem::setElementSize( ElementIndex index, QSizeF size )
+{
+    const auto oldRect = elementRect( index );
+    sizes[index] = size;
+    elementMoved( index, oldRect );
+}
+
+
+QColor InstancedGraphicsItem::elementColor( ElementIndex index ) const
+{
+    return QColor::fromRgba( colors.at( index ) );
+}
+
+
+void InstancedGraphicsItem::setElementColor(
+        ElementIndex index, const QColor & color )
+{
+    colors.at( index ) = color.rgba();
+    update( elementRect( index ) );
+}
+
+
+InstancedGraphicsItem::HandlerId InstancedGraphicsItem::elementHandlerId(
+        ElementIndex index ) const
+{
+    return handlerIds.at( index );
+}
+
+
+void InstancedGraphicsItem::setElementHandlerId(
+        ElementIndex index, HandlerId handlerId )
+{
+    assert( handlerId < handlerSets.size() );
+    handlerIds.at( index ) = handlerId;
+}
+
+
+QRectF InstancedGraphicsItem::elementRect( ElementIndex index ) const
+{
+    const auto center = centers.at( index );
+    const auto size = sizes[index];
+    return QRectF( center.x() - size.width() / 2,
+                   center.y() - size.height() / 2,
+                   size.width(), size.height() );
+}
+
+
+InstancedGraphicsItem::ElementIndex InstancedGraphicsItem::elementAt(
+        QPointF pos ) const
+{
+    ensureGrid();
+    auto result = noElement;
+    if ( grid.nColumns > 0 && grid.bounds.contains( pos ) )
+    {
+        const auto cell = cellOf( pos );
+        const auto cellIndex = cell.second * grid.nColumns + cell.first;
+        const auto begin = grid.entries.begin() + grid.cellStarts[cellIndex];
+        auto it = grid.entries.begin() + grid.cellStarts[cellIndex+1];
+        // Elements with higher indices are on top.
+        while ( it != begin )
+        {
+            const auto index = *--it;
+            if ( index < centers.size() && !isUnindexed[index] &&
+                 contains( index, pos ) )
+            {
+                result = index;
+                break;
+            }
+        }
+    }
+    for ( const auto index : unindexed )
+        if ( index < centers.size() &&
+             ( result == noElement || index > result ) && contains( index, pos ) )
+            result = index;
+    return result;
+}
+
+
+InstancedGraphicsItem::HandlerId InstancedGraphicsItem::addHandlers()
+{
+    handlerSets.push_back( std::make_unique<Handlers>() );
+    return HandlerId( handlerSets.size() - 1 );
+}
+
+
+QRectF InstancedGraphicsItem::boundingRect() const
+{
+    return bounds;
+}
+
+
+void InstancedGraphicsItem::paint( QPainter * painter
+                                 , const QStyleOptionGraphicsItem * option
+                                 , QWidget * )
+{
+    const auto isAllExposed = option->exposedRect.contains( bounds );
+    std::vector<ElementIndex> exposed;
+    if ( !isAllExposed )
+        exposed = elementsIn( option->exposedRect );
+    const auto nElements = isAllExposed ? centers.size() : exposed.size();
+    const auto levelOfDetail =
+            option->levelOfDetailFromTransform( painter->worldTransform() );
+
+    std::vector<QRectF> batch;
+    std::vector<QRectF> smallEllipses;
+    QRgb batchColor = 0;
+    const auto drawBatch = [&]
+    {
+        if ( batch.empty() )
+            return;
+        painter->setBrush( QColor::fromRgba( batchColor ) );
+        if ( elementShape == ElementShape::Ellipse )
+        {
+            // The ellipses of a batch are filled as one path. Overlapping
+            // ellipses must not cancel out, hence the winding fill.
+            QPainterPath ellipses;
+            ellipses.setFillRule( Qt::WindingFill );
+            for ( const auto & rect : batch )
+            {
+                if ( std::max( rect.width(), rect.height() ) * levelOfDetail
+                     < minEllipseExtent )
+                    smallEllipses.push_back( rect );
+                else
+                    ellipses.addEllipse( rect );
+            }
+            if ( !ellipses.isEmpty() )
+                painter->drawPath( ellipses );
+            batch.swap( smallEllipses );
+            smallEllipses.clear();
+        }
+        if ( !batch.empty() )
+            painter->drawRects( batch.data(), int( batch.size() ) );
+        batch.clear();
+    };
+
+    painter->save();
+    painter->setPen( Qt::NoPen );
+    for ( std::size_t i = 0; i != nElements; ++i )
+    {
+        const auto index = isAllExposed ? i : exposed[i];
+        if ( colors[index] != batchColor || batch.size() == maxBatchSize )
+        {
+            drawBatch();
+            batchColor = colors[index];
+        }
+        batch.push_back( elementRect( index ) );
+    }
+    drawBatch();
+    painter->restore();
+}
+
+
+int InstancedGraphicsItem::type() const
+{
+    return Type;
+}
+
+
+template <typename EventType>
+bool InstancedGraphicsItem::hasHandler(
+        ElementIndex index, Handler<EventType> Handlers::* handler ) const
+{
+    return index != noElement &&
+           static_cast<bool>( ( *handlerSets[handlerIds[index]] ).*handler );
+}
+
+
+template <typename EventType>
+bool InstancedGraphicsItem::callHandler(
+        ElementIndex index
+        , Handler<EventType> Handlers::* handler
+        , EventType * event )
+{
+    if ( !hasHandler( index, handler ) )
+        return false;
+    struct Guard
+    {
+        ~Guard()
+        {
+            if ( --self->dispatchDepth == 0 )
+                self->retiredHandlers.clear();
+        }
+        InstancedGraphicsItem * self;
+    } guard{ this };
+    ++dispatchDepth;
+    ( ( *handlerSets[handlerIds[index]] ).*handler )( this, index, event );
+    return true;
+}
+
+
+bool InstancedGraphicsItem::hasMouseHandlers( ElementIndex index ) const
+{
+    return hasHandler( index, &Handlers::mousePressEvent ) ||
+           hasHandler( index, &Handlers::mouseMoveEvent ) ||
+           hasHandler( index, &Handlers::mouseReleaseEvent ) ||
+           hasHandler( index, &Handlers::mouseDoubleClickEvent );
+}
+
+
+void InstancedGraphicsItem::updateAcceptedEvents()
+{
+    auto acceptsHover = false;
+    auto acceptsDrops = false;
+    for ( const auto & handlers : handlerSets )
+    {
+        acceptsHover = acceptsHover ||
+                handlers->hoverEnterEvent ||
+                handlers->hoverLeaveEvent ||
+                handlers->hoverMoveEvent;
+        acceptsDrops = acceptsDrops ||
+                handlers->dragEnterEvent ||
+                handlers->dragLeaveEvent ||
+                handlers->dragMoveEvent ||
+                handlers->dropEvent;
+    }
+    setAcceptHoverEvents( acceptsHover );
+    setAcceptDrops( acceptsDrops );
+}
+
+
+void InstancedGraphicsItem::growBounds( const QRectF & rect )
+{
+    const auto united = bounds | rect;
+    if ( united == bounds )
+        return;
+    prepareGeometryChange();
+    bounds = united;
+}
+
+
+void InstancedGraphicsItem::elementMoved(
+        ElementIndex index, const QRectF & oldRect )
+{
+    const auto newRect = elementRect( index );
+    growBounds( newRect );
+    update( oldRect );
+    update( newRect );
+    if ( !isGridValid || isUnindexed[index] )
+        return;
+    // The grid entries stay valid, if the element covers the same cells.
+    if ( !grid.bounds.contains( newRect ) ||
+         cellOf( oldRect.topLeft() ) != cellOf( newRect.topLeft() ) ||
+         cellOf( oldRect.bottomRight() ) != cellOf( newRect.bottomRight() ) )
+        markUnindexed( index );
+}
+
+
+void InstancedGraphicsItem::markUnindexed( ElementIndex index ) const
+{
+    unindexed.push_back( std::uint32_t( index ) );
+    isUnindexed[index] = true;
+    // Testing too many elements one by one is slower than rebuilding.
+    if ( unindexed.size() > 64 + centers.size() / 16 )
+        isGridValid = false;
+}
+
+
+void InstancedGraphicsItem::invalidateGrid()
+{
+    isGridValid = false;
+    unindexed.clear();
+}
+
+
+bool InstancedGraphicsItem::contains( ElementIndex index, QPointF pos ) const
+{
+    const auto rect = elementRect( index );
+    if ( !rect.contains( pos ) )
+        return false;
+    if ( elementShape == ElementShape::Rectangle ||
+         rect.width() <= 0 || rect.height() <= 0 )
+        return true;
+    const auto dx = ( pos.x() - centers[index].x() ) / ( rect.width() / 2 );
+    const auto dy = ( pos.y() - centers[index].y() ) / ( rect.height() / 2 );
+    return dx * dx + dy * dy <= 1;
+}
+
+
+void InstancedGraphicsItem::ensureGrid() const
+{
+    if ( !isGridValid )
+        buildGrid();
+}
+
+
+void InstancedGraphicsItem::buildGrid() const
+{
+    const auto nElements = centers.size();
+    unindexed.clear();
+    isUnindexed.assign( nElements, false );
+    isGridValid = true;
+    grid.bounds = QRectF();
+    grid.nColumns = 0;
+    grid.nRows = 0;
+    grid.cellStarts.clear();
+    grid.entries.clear();
+    if ( nElements == 0 )
+        return;
+
+    // The cells are about as large as the elements, but there are not
+    // many more cells than elements.
+    auto left = std::numeric_limits<double>::max();
+    auto top = left;
+    auto right = std::numeric_limits<double>::lowest();
+    auto bottom = right;
+    auto extentSum = 0.;
+    for ( std::size_t i = 0; i != nElements; ++i )
+    {
+        const auto rect = elementRect( i );
+        left = std::min( left, rect.left() );
+        top = std::min( top, rect.top() );
+        right = std::max( right, rect.right() );
+        bottom = std::max( bottom, rect.bottom() );
+        extentSum += std::max( rect.width(), rect.height() );
+    }
+    grid.bounds = QRectF( left, top, right - left, bottom - top );
+    const auto area = std::max( grid.bounds.width(), 1e-9 ) *
+                      std::max( grid.bounds.height(), 1e-9 );
+    grid.cellSize = std::max( extentSum / nElements,
+                              std::sqrt( area / nElements ) );
+    // If the elements are tiny and lie on a line, then the cells would be
+    // tiny, too, and there would be far more cells than elements.
+    const auto maxCells = 4. * nElements + 16;
+    while ( ( std::floor( grid.bounds.width() / grid.cellSize ) + 1 ) *
+            ( std::floor( grid.bounds.height() / grid.cellSize ) + 1 ) > maxCells )
+        grid.cellSize *= 2;
+    grid.nColumns = std::size_t( grid.bounds.width() / grid.cellSize ) + 1;
+    grid.nRows = std::size_t( grid.bounds.height() / grid.cellSize ) + 1;
+
+    // Counting sort of the elements by cell.
+    grid.cellStarts.assign( grid.nColumns * grid.nRows + 1, 0 );
+    const auto forEachCell = [this]( std::size_t index, auto && f )
+    {
+        const auto rect = elementRect( index );
+        const auto first = cellOf( rect.topLeft() );
+        const auto last = cellOf( rect.bottomRight() );
+        for ( auto row = first.second; row <= last.second; ++row )
+            for ( auto column = first.first; column <= last.first; ++column )
+                f( row * grid.nColumns + column );
+    };
+    for ( std::size_t i = 0; i != nElements; ++i )
+        forEachCell( i, [this]( std::size_t cell )
+        {
+            ++grid.cellStarts[cell+1];
+        } );
+    std::partial_sum( grid.cellStarts.begin(), grid.cellStarts.end(),
+                      grid.cellStarts.begin() );
+    grid.entries.resize( grid.cellStarts.back() );
+    auto ends = grid.cellStarts;
+    for ( std::size_t i = 0; i != nElements; ++i )
+        forEachCell( i, [&]( std::size_t cell )
+        {
+            grid.entries[ends[cell]++] = std::uint32_t( i );
+        } );
+}
+
+
+std::pair<std::size_t,std::size_t> InstancedGraphicsItem::cellOf(
+        QPointF pos ) const
+{
+    const auto clamp = []( double x, std::size_t n )
+    {
+        return std::size_t( std::clamp( x, 0., double( n - 1 ) ) );
+    };
+    return { clamp( ( pos.x() - grid.bounds.left() ) / grid.cellSize,
+                    grid.nColumns ),
+             clamp( ( pos.y() - grid.bounds.top() ) / grid.cellSize,
+                    grid.nRows ) };
+}
+
+
+std::vector<InstancedGraphicsItem::ElementIndex>
+    InstancedGraphicsItem::elementsIn( const QRectF & rect ) const
+{
+    ensureGrid();
+    std::vector<ElementIndex> result;
+    if ( grid.nColumns > 0 && grid.bounds.intersects( rect ) )
+    {
+        const auto first = cellOf( rect.topLeft() );
+        const auto last = cellOf( rect.bottomRight() );
+        for ( auto row = first.second; row <= last.second; ++row )
+            for ( auto column = first.first; column <= last.first; ++column )
+            {
+                const auto cell = row * grid.nColumns + column;
+                for ( auto k = grid.cellStarts[cell];
+                      k != grid.cellStarts[cell+1]; ++k )
+                {
+                    const auto index = grid.entries[k];
+                    if ( index < centers.size() && !isUnindexed[index] &&
+                         elementRect( index ).intersects( rect ) )
+                        result.push_back( index );
+                }
+            }
+    }
+    for ( const auto index : unindexed )
+        if ( index < centers.size() && elementRect( index ).intersects( rect ) )
+            result.push_back( index );
+    // Elements covering several cells have been found several times.
+    std::sort( result.begin(), result.end() );
+    result.erase( std::unique( result.begin(), result.end() ), result.end() );
+    return result;
+}
+
+
+void InstancedGraphicsItem::setHovered(
+        ElementIndex index, QGraphicsSceneHoverEvent * event )
+{
+    if ( index == hoveredElement )
+        return;
+    const auto left = hoveredElement;
+    hoveredElement = index;
+    callHandler( left, &Handlers::hoverLeaveEvent, event );
+    // The leave handler may have removed the entered element.
+    callHandler( hoveredElement, &Handlers::hoverEnterEvent, event );
+}
+
+
+void InstancedGraphicsItem::setDragged(
+        ElementIndex index, QGraphicsSceneDragDropEvent * event )
+{
+    if ( index == draggedElement )
+        return;
+    const auto left = draggedElement;
+    draggedElement = index;
+    callHandler( left, &Handlers::dragLeaveEvent, event );
+    callHandler( draggedElement, &Handlers::dragEnterEvent, event );
+}
+
+
+void InstancedGraphicsItem::retarget(
+        ElementIndex & tracked, ElementIndex removed, ElementIndex moved )
+{
+    if ( tracked == removed )
+        tracked = noElement;
+    else if ( tracked == moved )
+        tracked = removed;
+}
+
+
+void InstancedGraphicsItem::dragEnterEvent( QGraphicsSceneDragDropEvent * event )
+{
+    // The drag is accepted by the item as a whole, so that it receives the
+    // moves over all of its elements.
+    event->accept();
+    setDragged( elementAt( event->pos() ), event );
+}
+
+
+void InstancedGraphicsItem::dragLeaveEvent( QGraphicsSceneDragDropEvent * event )
+{
+    setDragged( noElement, event );
+}
+
+
+void InstancedGraphicsItem::dragMoveEvent( QGraphicsSceneDragDropEvent * event )
+{
+    setDragged( elementAt( event->pos() ), event );
+    // Whether a drop is possible here. The handler may override this.
+    event->setAccepted( hasHandler( draggedElement, &Handlers::dropEvent ) );
+    callHandler( draggedElement, &Handlers::dragMoveEvent, event );
+}
+
+
+void InstancedGraphicsItem::dropEvent( QGraphicsSceneDragDropEvent * event )
+{
+    draggedElement = noElement;
+    if ( !callHandler( elementAt( event->pos() ), &Handlers::dropEvent, event ) )
+        event->ignore();
+}
+
+
+void InstancedGraphicsItem::hoverEnterEvent( QGraphicsSceneHoverEvent * event )
+{
+    setHovered( elementAt( event->pos() ), event );
+}
+
+
+void InstancedGraphicsItem::hoverLeaveEvent( QGraphicsSceneHoverEvent * event )
+{
+    setHovered( noElement, event );
+}
+
+
+void InstancedGraphicsItem::hoverMoveEvent( QGraphicsSceneHoverEvent * event )
+{
+    setHovered( elementAt( event->pos() ), event );
+    callHandler( hoveredElement, &Handlers::hoverMoveEvent, event );
+}
+
+
+void InstancedGraphicsItem::mouseDoubleClickEvent( QGraphicsSceneMouseEvent * event )
+{
+    const auto index = elementAt( event->pos() );
+    // Like QGraphicsItem, a double click is a press by default.
+    if ( !hasHandler( index, &Handlers::mouseDoubleClickEvent ) )
+        return mousePressEvent( event );
+    grabbedElement = index;
+    callHandler( index, &Handlers::mouseDoubleClickEvent, event );
+}
+
+
+void InstancedGraphicsItem::mouseMoveEvent( QGraphicsSceneMouseEvent * event )
+{
+    callHandler( grabbedElement, &Handlers::mouseMoveEvent, event );
+}
+
+
+void InstancedGraphicsItem::mousePressEvent( QGraphicsSceneMouseEvent * event )
+{
+    const auto index = elementAt( event->pos() );
+    // Without accepting the press the item would not receive the moves
+    // and the release.
+    if ( !hasMouseHandlers( index ) )
+    {
+        grabbedElement = noElement;
+        event->ignore();
+        return;
+    }
+    grabbedElement = index;
+    callHandler( index, &Handlers::mousePressEvent, event );
+}
+
+
+void InstancedGraphicsItem::mouseReleaseEvent( QGraphicsSceneMouseEvent * event )
+{
+    const auto index = grabbedElement;
+    grabbedElement = noElement;
+    callHandler( index, &Handlers::mouseReleaseEvent, event );
+}
+
+} // namespace qu
@@ -0,0 +1,270 @@
+/// @file
+///
+/// @brief A graphics item that draws many small elements and dispatches
+///     events to handlers per element.
+
+#pragma once
+
+#include <QColor>
+#include <QGraphicsItem>
+#include <QPointF>
+#include <QRectF>
+#include <QSizeF>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/// Calls @c X(EventName,eventName,EventType) for each event of an element
+/// of an @c InstancedGraphicsItem that can be handled.
+#define QU_FOR_EACH_INSTANCED_ELEMENT_EVENT( X ) \
+    X( DragEnterEvent       , dragEnterEvent       , QGraphicsSceneDragDropEvent ) \
+    X( DragLeaveEvent       , dragLeaveEvent       , QGraphicsSceneDragDropEvent ) \
+    X( DragMoveEvent        , dragMoveEvent        , QGraphicsSceneDragDropEvent ) \
+    X( DropEvent            , dropEvent            , QGraphicsSceneDragDropEvent ) \
+    X( HoverEnterEvent      , hoverEnterEvent      , QGraphicsSceneHoverEvent    ) \
+    X( HoverLeaveEvent      , hoverLeaveEvent      , QGraphicsSceneHoverEvent    ) \
+    X( HoverMoveEvent       , hoverMoveEvent       , QGraphicsSceneHoverEvent    ) \
+    X( MouseDoubleClickEvent, mouseDoubleClickEvent, QGraphicsSceneMouseEvent    ) \
+    X( MouseMoveEvent       , mouseMoveEvent       , QGraphicsSceneMouseEvent    ) \
+    X( MousePressEvent      , mousePressEvent      , QGraphicsSceneMouseEvent    ) \
+    X( MouseReleaseEvent    , mouseReleaseEvent    , QGraphicsSceneMouseEvent    )
+
+namespace qu
+{
+
+/// @brief A single graphics item standing in for a large number of small
+/// elements, such as the points of a scatter plot.
+///
+/// A @c QGraphicsItem per point costs hundreds of bytes and makes the scene
+/// index and the painting scale with the number of items. This item keeps
+/// its elements in separate arrays of centers, sizes, colors and handler
+/// ids, i.e. about 40 bytes per element plus the hit testing grid. It
+/// paints them in one pass, in which neighbouring elements of the same
+/// color are drawn together, and only the elements within the exposed
+/// rectangle are visited. Rectangles are drawn with a single call, and so
+/// are ellipses, which are filled as one path. Ellipses smaller than two
+/// device pixels are drawn as rectangles.
+///
+/// Events are routed to elements like @c EventHandlingGraphicsItem routes
+/// them to items. Handlers are not stored per element, though, but in
+/// handler sets, which are referenced by the handler id of an element.
+/// Handlers take the item, the index of the element and the event. An
+/// element is hit, if the position of the event lies within its shape,
+/// and elements with higher indices are on top. Hit testing uses a uniform
+/// grid, which is rebuilt lazily after many elements have changed.
+///
+/// Mouse move and release events go to the element that received the
+/// press. Hover and drag enter and leave handlers are called whenever the
+/// element under the cursor changes, with the move event that caused the
+/// change. Mouse and drag events of elements without a handler are
+/// ignored, so they propagate to the items below. Hover events do not:
+/// while any element has a hover handler, the item accepts hover events
+/// within its whole bounding rectangle, so the items below it receive none
+/// there. Handlers may change and remove elements and set handlers, but
+/// must not delete the item.
+class InstancedGraphicsItem
+    : public QGraphicsItem
+{
+public:
+    using ElementIndex = std::size_t;
+    using HandlerId = std::uint32_t;
+
+    template <typename EventType>
+    using Handler = std::function<void(InstancedGraphicsItem*,ElementIndex,EventType*)>;
+
+    /// Returned by @c elementAt(), if no element is hit.
+    static constexpr ElementIndex noElement = ElementIndex(-1);
+
+    /// The handler set of elements added without a handler id.
+    static constexpr HandlerId defaultHandlers = 0;
+
+    enum class ElementShape
+    {
+        Rectangle,
+        Ellipse,
+    };
+
+    enum { Type = UserType + 0x7155 };
+
+    explicit InstancedGraphicsItem( QGraphicsItem * parent = nullptr );
+
+    virtual ~InstancedGraphicsItem();
+
+    /// The shape of all elements. Initially @c ElementShape::Ellipse.
+    void setElementShape( ElementShape shape );
+    ElementShape getElementShape() const;
+
+    void reserve( std::size_t nElements );
+
+    /// @brief Appends an element and returns its index.
+    ///
+    /// The element is drawn centered at @c center.
+    ElementIndex addElement( QPointF center
+                           , QSizeF size
+                           , const QColor & color
+                           , HandlerId handlerId = defaultHandlers );
+
+    /// @brief Removes the element at @c index.
+    ///
+    /// The last element takes its place, so the index of the last element
+    /// changes to @c index.
+    void removeElement( ElementIndex index );
+
+    /// Removes all elements. The handler sets are kept.
+    void clear();
+
+    std::size_t elementCount() const;
+
+    QPointF elementCenter( ElementIndex index ) const;
+    void setElementCenter( ElementIndex index, QPointF center );
+
+    QSizeF elementSize( ElementIndex index ) const;
+    void setElementSize( ElementIndex index, QSizeF size );
+
+    QColor elementColor( ElementIndex index ) const;
+    void setElementColor( ElementIndex index, const QColor & color );
+
+    HandlerId elementHandlerId( ElementIndex index ) const;
+    void setElementHandlerId( ElementIndex index, HandlerId handlerId );
+
+    /// Returns the rectangle of the element in item coordinates.
+    QRectF elementRect( ElementIndex index ) const;
+
+    /// Returns the top-most element whose shape contains @c pos, or
+    /// @c noElement.
+    ElementIndex elementAt( QPointF pos ) const;
+
+    /// Creates an empty handler set and returns its id.
+    HandlerId addHandlers();
+
+    /// @brief Returns the bounding rectangle of the elements.
+    ///
+    /// It grows with the elements, but only shrinks when @c clear() is
+    /// called.
+    virtual QRectF boundingRect() const override;
+
+    virtual void paint( QPainter * painter
+                      , const QStyleOptionGraphicsItem * option
+                      , QWidget * widget = nullptr ) override;
+
+    virtual int type() const override;
+
+private:
+    struct Handlers
+    {
+#define DECLARE_EVENT_HANDLER( EventName, eventName, EventType ) \
+        Handler<EventType> eventName;
+
+        QU_FOR_EACH_INSTANCED_ELEMENT_EVENT( DECLARE_EVENT_HANDLER )
+
+#undef DECLARE_EVENT_HANDLER
+    };
+
+    /// A uniform grid over the elements. The elements overlapping a cell
+    /// are stored contiguously and in ascending order.
+    struct Grid
+    {
+        QRectF bounds;
+        double cellSize = 1;
+        std::size_t nColumns = 0;
+        std::size_t nRows = 0;
+        std::vector<std::uint32_t> cellStarts;
+        std::vector<std::uint32_t> entries;
+    };
+
+    template <typename EventType, typename F>
+    void setHandler( HandlerId handlerId
+                   , Handler<EventType> Handlers::* handler
+                   , F && f )
+    {
+        auto & handlers = handlerSets.at( handlerId );
+        // A running handler must neither be destroyed nor moved, so the
+        // set is replaced by a copy.
+        if ( dispatchDepth > 0 )
+        {
+            auto copy = std::make_unique<Handlers>( *handlers );
+            retiredHandlers.push_back( std::move(handlers) );
+            handlers = std::move(copy);
+        }
+        (*handlers).*handler = std::forward<F>(f);
+        updateAcceptedEvents();
+    }
+
+    template <typename EventType>
+    bool hasHandler( ElementIndex index
+                   , Handler<EventType> Handlers::* handler ) const;
+
+    template <typename EventType>
+    bool callHandler( ElementIndex index
+                    , Handler<EventType> Handlers::* handler
+                    , EventType * event );
+
+    bool hasMouseHandlers( ElementIndex index ) const;
+    void updateAcceptedEvents();
+    void growBounds( const QRectF & rect );
+    void elementMoved( ElementIndex index, const QRectF & oldRect );
+    void markUnindexed( ElementIndex index ) const;
+    void invalidateGrid();
+    bool contains( ElementIndex index, QPointF pos ) const;
+    void ensureGrid() const;
+    void buildGrid() const;
+    std::pair<std::size_t,std::size_t> cellOf( QPointF pos ) const;
+    std::vector<ElementIndex> elementsIn( const QRectF & rect ) const;
+    void setHovered( ElementIndex index, QGraphicsSceneHoverEvent * event );
+    void setDragged( ElementIndex index, QGraphicsSceneDragDropEvent * event );
+    void retarget( ElementIndex & tracked, ElementIndex removed,
+                   ElementIndex moved );
+
+    ElementShape elementShape = ElementShape::Ellipse;
+    std::vector<QPointF> centers;
+    std::vector<QSizeF> sizes;
+    std::vector<QRgb> colors;
+    std::vector<HandlerId> handlerIds;
+    QRectF bounds;
+
+    mutable Grid grid;
+    mutable bool isGridValid = false;
+    // Elements added, moved across cells or moved by a removal since the
+    // grid was built. They are tested one by one and their grid entries
+    // are ignored, as are entries and indices beyond the last element.
+    mutable std::vector<std::uint32_t> unindexed;
+    mutable std::vector<bool> isUnindexed;
+
+    std::vector<std::unique_ptr<Handlers>> handlerSets;
+    // Handler sets replaced while handlers are running are kept alive
+    // until all of them have returned.
+    int dispatchDepth = 0;
+    std::vector<std::unique_ptr<Handlers>> retiredHandlers;
+
+    ElementIndex grabbedElement = noElement;
+    ElementIndex hoveredElement = noElement;
+    ElementIndex draggedElement = noElement;
+
+#define IMPLEMENT_EVENT_HANDLER( EventName, eventName, EventType ) \
+public: \
+    /** Sets the handler of the set @c handlerId. An empty handler */ \
+    /** removes it. */ \
+    template <typename F> \
+    void set##EventName##Handler( HandlerId handlerId, F && f ) \
+    { \
+        setHandler( handlerId, &Handlers::eventName, std::forward<F>(f) ); \
+    } \
+\
+    const Handler<EventType> & get##EventName##Handler( HandlerId handlerId ) const \
+    { \
+        return handlerSets.at( handlerId )->eventName; \
+    } \
+\
+protected: \
+    virtual void eventName( EventType * event ) override;
+
+    QU_FOR_EACH_INSTANCED_ELEMENT_EVENT( IMPLEMENT_EVENT_HANDLER )
+
+#undef IMPLEMENT_EVENT_HANDLER
+};
+
+} // namespace qu
@@ -5,13 +5,16 @@
 
 #pragma once
 
-#include <../cpp_utils/std_make_unique.h>
+#include "future.h"
+#include "thread_dispatcher.h"
 
 #include <QApplication>
-#include <QObject>
 #include <QThread>
-#include <future>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
 
 namespace qu
 {
@@ -19,27 +22,22 @@ namespace qu
 namespace detail
 {
 
-    class InvokeInThreadHelper
-        : public QObject
+    /// Dispatches @c f to @c thread and provides its result through
+    /// a future. @c mode is a connection type or an @c InvokePriority.
+    template <typename F, typename Mode>
+    auto invokeWithPromise( QThread * thread, F && f, Mode mode )
+        -> Future<decltype(f())>
     {
-        Q_OBJECT
-    public:
-        template <typename F>
-        InvokeInThreadHelper( F && f )
-            : f( std::forward<F>(f) )
-        {
-        }
-
-    public slots:
-        void runAndDeleteMe()
-        {
-            f();
-            delete this;
-        }
-
-    private:
-        std::function<void()> f;
-    };
+        using RetType = decltype(f());
+        Promise<RetType> promise;
+        auto future = promise.getFuture();
+        dispatch( thread, makePromiseTask( std::move(promise),
+            [f = std::forward<F>(f)]( Promise<RetType> & promise ) mutable
+            {
+                fulfil( promise, f );
+            } ), mode );
+        return future;
+    }
 
 } // namespace detail
 
@@ -48,26 +46,35 @@ namespace detail
 ///
 /// The given thread must run a Qt event loop in order to dispatch the
 /// given functor. The asynchroneous result can be retrieved through
-/// the returned @c std::future. The connection type should not be
+/// the returned @c qu::Future, either blocking with @c Future::get() or
+/// without blocking by attaching a continuation with @c Future::then().
+/// The connection type should not be
 /// @c Qt::DirectConnection. The default value @c Qt::AutoConnection
 /// will arrange the call to be synchroneous, iff @c thread is the
 /// thread from which the function is called. If @c Qt::QueuedConnection
 /// is used, then the execution will always be pushed to the end of the
-/// event queue of @c thread.
+/// invocation queue of @c thread. Queued invocations are executed in the
+/// order they were made and a burst of them is handled by a single event
+/// (see @c detail::ThreadDispatcher).
 template <typename F>
 auto invokeInThread( QThread * thread, F && f,
                      Qt::ConnectionType connectionType = Qt::AutoConnection )
-    -> std::future<decltype(f())>
+    -> Future<decltype(f())>
 {
-    using RetType = decltype(f());
-    auto task = std::make_shared<std::packaged_task<RetType()>>( std::forward<F>(f) );
-    auto future = task->get_future();
-    auto invoker = std::make_unique<detail::InvokeInThreadHelper>(
-                [=]() { (*task)(); } );
-    invoker->moveToThread( thread );
-    QMetaObject::invokeMethod( invoker.get(), "runAndDeleteMe", connectionType );
-    invoker.release();
-    return future;
+    return detail::invokeWithPromise( thread, std::forward<F>(f),
+                                      connectionType );
+}
+
+/// \brief Like @c invokeInThread(), but queued with the given priority.
+///
+/// The invocation is always queued, even if @c thread is the current
+/// thread. See @c InvokePriority for the meaning of the priorities.
+template <typename F>
+auto invokeInThread( QThread * thread, F && f, InvokePriority priority )
+    -> Future<decltype(f())>
+{
+    return detail::invokeWithPromise( thread, std::forward<F>(f),
+                                      priority );
 }
 
 /// \brief Spawns a functor in the event loop of the Qt gui thread.
@@ -78,17 +85,27 @@ auto invokeInThread( QThread * thread, F && f,
 template <typename F>
 auto invokeInGuiThread( F && f,
                         Qt::ConnectionType connectionType = Qt::AutoConnection )
-    -> std::future<decltype(f())>
+    -> Future<decltype(f())>
 {
     return invokeInThread( QApplication::instance()->thread(),
                            std::forward<F>(f),
                            std::move(connectionType) );
 }
 
+/// Like @c invokeInGuiThread(), but queued with the given priority.
+template <typename F>
+auto invokeInGuiThread( F && f, InvokePriority priority )
+    -> Future<decltype(f())>
+{
+    return invokeInThread( QApplication::instance()->thread(),
+                           std::forward<F>(f),
+                           priority );
+}
+
 /// Like @c invokeInThread(), but with a @c Qt::QueuedConnection.
 template <typename F>
 auto invokeInThreadAsync( QThread * thread, F && f )
-    -> std::future<decltype(f())>
+    -> Future<decltype(f())>
 {
     return invokeInThread( thread,
                            std::forward<F>(f),
@@ -98,7 +115,7 @@ auto invokeInThreadAsync( QThread * thread, F && f )
 /// Like @c InvokeInGuiThread(), but with a @c Qt::QueuedConnection.
 template <typename F>
 auto invokeInGuiThreadAsync( F && f )
-    -> std::future<decltype(f())>
+    -> Future<decltype(f())>
 {
     return invokeInGuiThread( std::forward<F>(f),
                               Qt::QueuedConnection );
@@ -123,5 +140,200 @@ auto invokeInGuiThreadSync( F && f )
                               Qt::AutoConnection ).get();
 }
 
+/// \brief Spawns a functor in the event loop of a @c QThread without
+/// providing its result.
+///
+/// This is the fire-and-forget variant of @c invokeInThread(). It does
+/// not create a future or any shared state. Functors of up to
+/// @c detail::DispatchTask::inlineCapacity bytes are stored inline, so
+/// for small captures no heap allocation takes place. Exceptions thrown
+/// by @c f propagate into the event loop of @c thread.
+template <typename F>
+void postToThread( QThread * thread, F && f,
+                   Qt::ConnectionType connectionType = Qt::AutoConnection )
+{
+    detail::dispatch( thread, std::forward<F>(f), connectionType );
+}
+
+/// Like @c postToThread(), but queued with the given priority.
+template <typename F>
+void postToThread( QThread * thread, F && f, InvokePriority priority )
+{
+    detail::dispatch( thread, std::forward<F>(f), priority );
+}
+
+/// Like @c postToThread(), but passing a pointer to the Qt gui thread.
+template <typename F>
+void postToGuiThread( F && f,
+                      Qt::ConnectionType connectionType = Qt::AutoConnection )
+{
+    postToThread( QApplication::instance()->thread(),
+                  std::forward<F>(f),
+                  connectionType );
+}
+
+/// Like @c postToGuiThread(), but queued with the given priority.
+template <typename F>
+void postToGuiThread( F && f, InvokePriority priority )
+{
+    postToThread( QApplication::instance()->thread(),
+                  std::forward<F>(f),
+                  priority );
+}
+
+/// \brief Spawns a functor in the event loop of a @c QThread, replacing
+/// a pending functor with the same key.
+///
+/// This is meant for updates where only the latest value matters, e.g.
+/// setting the text of a label from a worker thread. If a functor that
+/// was posted with the same @c key has not been run yet, then it is
+/// destroyed without being run and @c f takes its place in the queue.
+/// Hence at most one invocation per key is pending at any time, however
+/// fast the producer is. A typical key is the address of the object being
+/// updated. The invocation is always queued. If functors with the same
+/// key are posted with different priorities, then the priority of the
+/// first pending one applies.
+template <typename F>
+void invokeInThreadCoalesced(
+        QThread * thread, const void * key, F && f,
+        InvokePriority priority = InvokePriority::Normal )
+{
+    detail::ThreadDispatcher::forThread( thread ).postCoalesced(
+        key, new detail::DispatchTask( std::forward<F>(f) ), priority );
+}
+
+/// Like @c invokeInThreadCoalesced(), but passing a pointer to the Qt gui
+/// thread.
+template <typename F>
+void invokeInGuiThreadCoalesced(
+        const void * key, F && f,
+        InvokePriority priority = InvokePriority::Normal )
+{
+    invokeInThreadCoalesced( QApplication::instance()->thread(), key,
+                             std::forward<F>(f), priority );
+}
+
+/// \brief Calls a functor in the event loop of a @c QThread after a delay.
+///
+/// Unlike a @c QTimer, no @c QObject is created. All delayed invocations
+/// of a thread share a timer wheel with a single native timer (see
+/// @c detail::ThreadDispatcher). The invocation may be late by up to
+/// about 1/32 of @c delay, since nearby deadlines are coalesced. The
+/// returned handle cancels the invocation. Exceptions thrown by @c f
+/// propagate into the event loop of @c thread.
+template <typename F>
+TimerHandle invokeInThreadAfter(
+        QThread * thread, std::chrono::nanoseconds delay, F && f )
+{
+    auto cancelled = std::make_shared<std::atomic<bool>>( false );
+    detail::ThreadDispatcher::forThread( thread ).schedule(
+        std::make_unique<detail::ScheduledTask>(
+            std::forward<F>(f), cancelled, std::chrono::nanoseconds( 0 ) ),
+        delay );
+    return TimerHandle( std::move(cancelled) );
+}
+
+/// \brief Calls a functor in the event loop of a @c QThread periodically
+/// until it is cancelled.
+///
+/// The first call is made after one @c period. Periods are measured from
+/// the previous deadline rather than from the previous call, so the calls
+/// do not drift. If calls are missed because the thread was busy, then
+/// they are skipped rather than made up for. Otherwise the same applies
+/// as for @c invokeInThreadAfter(). If @c f throws, the calls continue.
+template <typename F>
+TimerHandle invokeInThreadEvery(
+        QThread * thread, std::chrono::nanoseconds period, F && f )
+{
+    auto cancelled = std::make_shared<std::atomic<bool>>( false );
+    detail::ThreadDispatcher::forThread( thread ).schedule(
+        std::make_unique<detail::ScheduledTask>(
+            std::forward<F>(f), cancelled,
+            std::max( period, std::chrono::nanoseconds( 1 ) ) ),
+        period );
+    return TimerHandle( std::move(cancelled) );
+}
+
+/// Like @c invokeInThreadAfter(), but passing a pointer to the Qt gui
+/// thread.
+template <typename F>
+TimerHandle invokeInGuiThreadAfter( std::chrono::nanoseconds delay, F && f )
+{
+    return invokeInThreadAfter( QApplication::instance()->thread(), delay,
+                                std::forward<F>(f) );
+}
+
+/// Like @c invokeInThreadEvery(), but passing a pointer to the Qt gui
+/// thread.
+template <typename F>
+TimerHandle invokeInGuiThreadEvery( std::chrono::nanoseconds period, F && f )
+{
+    return invokeInThreadEvery( QApplication::instance()->thread(), period,
+                                std::forward<F>(f) );
+}
+
+/// \brief Limits the time per event loop iteration spent on invocations
+/// with @c InvokePriority::Background in @c thread.
+///
+/// The default is 4 milliseconds. A task is never interrupted, so a
+/// single long background task can still exceed the budget.
+inline void setBackgroundInvocationBudget(
+        QThread * thread, std::chrono::microseconds budget )
+{
+    detail::ThreadDispatcher::forThread( thread ).setBackgroundBudget( budget );
+}
+
+/// \brief Limits the number of pending invocations in @c thread.
+///
+/// Invocations count from being queued until they are started. A
+/// @c capacity of zero, which is the default, means no limit. When an
+/// invocation would exceed the capacity, @c policy decides what happens.
+/// With @c OverflowPolicy::Block, producers in other threads wait, while
+/// @c thread itself may always exceed the limit, since it would wait for
+/// itself otherwise. Beware that two threads blocking on each other's
+/// queue deadlock. Discarded invocations complete their futures with
+/// @c std::future_errc::broken_promise, rejected ones with
+/// @c QueueFullError. Functors of @c invokeInThreadCoalesced() are not
+/// limited, since there is at most one of them per key anyway.
+inline void setInvokeQueueCapacity(
+        QThread * thread, std::size_t capacity,
+        OverflowPolicy policy = OverflowPolicy::Block )
+{
+    detail::ThreadDispatcher::forThread( thread ).setCapacity( capacity, policy );
+}
+
+/// Returns the queue depth, the capacity and the drop counters of the
+/// invocation queue of @c thread.
+inline InvokeQueueStats getInvokeQueueStats( QThread * thread )
+{
+    return detail::ThreadDispatcher::forThread( thread ).getQueueStats();
+}
+
+/// \brief Switches the latency instrumentation of invocations on or off.
+///
+/// While switched on, every queued invocation is timestamped and the
+/// target thread records how long it waited in the queue and how long it
+/// ran. This costs two clock reads per invocation. It is off by default.
+inline void setInvokeInstrumentationEnabled( bool enabled )
+{
+    detail::isInstrumentationEnabled = enabled;
+}
+
+/// \brief Returns percentiles of the queue delays and execution times of
+/// the invocations in @c thread.
+///
+/// For example, comparing the 99th percentile of the queue delay of the
+/// gui thread with the frame period tells whether the gui keeps up.
+inline InvokeLatencyStats getInvokeLatencyStats( QThread * thread )
+{
+    return detail::ThreadDispatcher::forThread( thread ).getLatencyStats();
+}
+
+/// Clears the latencies recorded for @c thread. Called from another thread,
+/// the latencies are cleared once @c thread runs its queued invocations.
+inline void resetInvokeLatencyStats( QThread * thread )
+{
+    detail::ThreadDispatcher::forThread( thread ).resetLatencyStats();
+}
 
 } // namespace qu
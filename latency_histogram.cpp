@@ -0,0 +1,94 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace qu {
+
+namespace detail {
+
+namespace { // unnamed
+
+const int subBuckets = 8;
+
+int bucketIndex( std::uint64_t value )
+{
+    if ( value < subBuckets )
+        return int(value);
+    const int exponent = std::bit_width( value ) - 1;
+    const int mantissa = int( value >> (exponent - 3) ) & (subBuckets - 1);
+    return (exponent - 2) * subBuckets + mantissa;
+}
+
+// The largest value that falls into the bucket.
+std::uint64_t bucketUpperBound( int index )
+{
+    if ( index < subBuckets )
+        return std::uint64_t(index);
+    const int exponent = index / subBuckets + 2;
+    const auto mantissa = std::uint64_t( index % subBuckets );
+    const auto lower = (subBuckets + mantissa) << (exponent - 3);
+    return lower + (std::uint64_t(1) << (exponent - 3)) - 1;
+}
+
+} // unnamed namespace
+
+
+void LatencyHistogram::record( std::chrono::nanoseconds duration )
+{
+    const auto value = std::uint64_t( std::max<std::int64_t>( duration.count(), 0 ) );
+    auto & bucket = buckets[bucketIndex( value )];
+    // There is a single writer, so no read-modify-write is needed.
+    bucket.store( bucket.load( std::memory_order_relaxed ) + 1,
+                  std::memory_order_relaxed );
+    if ( value > maxValue.load( std::memory_order_relaxed ) )
+        maxValue.store( value, std::memory_order_relaxed );
+}
+
+
+LatencySummary LatencyHistogram::summarize() const
+{
+    std::uint64_t counts[nBuckets];
+    std::uint64_t total = 0;
+    for ( int i = 0; i != nBuckets; ++i )
+    {
+        counts[i] = buckets[i].load( std::memory_order_relaxed );
+        total += counts[i];
+    }
+
+    LatencySummary summary;
+    summary.count = total;
+    summary.max = std::chrono::nanoseconds(
+                maxValue.load( std::memory_order_relaxed ) );
+    if ( total == 0 )
+        return summary;
+
+    const auto percentile = [&]( double p )
+    {
+        const auto rank = std::uint64_t( p * double(total - 1) ) + 1;
+        std::uint64_t seen = 0;
+        for ( int i = 0; i != nBuckets; ++i )
+        {
+            seen += counts[i];
+            if ( seen >= rank )
+                return std::min( std::chrono::nanoseconds( bucketUpperBound( i ) ),
+                                 summary.max );
+        }
+        return summary.max;
+    };
+    summary.p50 = percentile( 0.50 );
+    summary.p99 = percentile( 0.99 );
+    return summary;
+}
+
+
+void LatencyHistogram::reset()
+{
+    for ( auto & bucket : buckets )
+        bucket.store( 0, std::memory_order_relaxed );
+    maxValue.store( 0, std::memory_order_relaxed );
+}
+
+} // namespace detail
+
+} // namespace qu
@@ -0,0 +1,52 @@
+/// @file
+///
+/// @brief Lock-free histogram of durations with percentile summaries.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace qu
+{
+
+/// Summary of the durations recorded by a @c detail::LatencyHistogram.
+struct LatencySummary
+{
+    std::uint64_t count = 0;
+    std::chrono::nanoseconds p50{ 0 };
+    std::chrono::nanoseconds p99{ 0 };
+    std::chrono::nanoseconds max{ 0 };
+};
+
+namespace detail
+{
+
+    /// @brief Histogram of durations with logarithmic buckets.
+    ///
+    /// Every power of two is split into 8 buckets, so percentiles are
+    /// reported with a relative error of at most 12.5 %. Recording is
+    /// wait-free and meant to be done by a single thread, while other
+    /// threads may take summaries at any time. Summaries taken while
+    /// recording is in progress may be slightly inconsistent.
+    class LatencyHistogram
+    {
+    public:
+        void record( std::chrono::nanoseconds duration );
+
+        LatencySummary summarize() const;
+
+        void reset();
+
+    private:
+        static const int subBucketBits = 3;
+        static const int nBuckets = 64 << subBucketBits;
+
+        std::atomic<std::uint64_t> buckets[nBuckets] = {};
+        std::atomic<std::uint64_t> maxValue{ 0 };
+    };
+
+} // namespace detail
+
+} // namespace qu
@@ -0,0 +1,313 @@
+#include "loop_thread.h"
+
+#include "thread_dispatcher.h"
+
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QEvent>
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+
+#ifdef Q_OS_LINUX
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace qu {
+
+namespace { // unnamed
+
+std::int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Tells the CPU that the current thread is spinning.
+inline void relaxCpu()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+#ifdef Q_OS_LINUX
+// Reads the first number of a file in /proc/self/task/<tid>/, optionally
+// from the line starting with "<field>:". Returns zero on failure.
+std::uint64_t readTaskValue( long tid, const char * fileName,
+                             const std::string & field = std::string() )
+{
+    std::ifstream file( "/proc/self/task/" + std::to_string( tid ) +
+                        "/" + fileName );
+    std::string line;
+    while ( std::getline( file, line ) )
+    {
+        if ( field.empty() )
+            return std::strtoull( line.c_str(), nullptr, 10 );
+        if ( line.compare( 0, field.size(), field ) == 0 &&
+             line.size() > field.size() && line[field.size()] == ':' )
+            return std::strtoull( line.c_str() + field.size() + 1,
+                                  nullptr, 10 );
+    }
+    return 0;
+}
+#endif
+
+} // unnamed namespace
+
+
+class LoopThread::LowLatencyWaker
+    : public detail::ThreadDispatcher::Waker
+{
+public:
+    virtual void wakeUp() override
+    {
+        notified = true;
+        if ( sleeping )
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            cv.notify_one();
+        }
+    }
+
+    bool isNotified() const
+    {
+        return notified.load();
+    }
+
+    void reset()
+    {
+        notified = false;
+    }
+
+    void waitUntil( std::chrono::steady_clock::time_point deadline )
+    {
+        // Either the waker sees the flag sleeping or this thread sees the
+        // flag notified, since both are sequentially consistent.
+        std::unique_lock<std::mutex> lock( mutex );
+        sleeping = true;
+        cv.wait_until( lock, deadline, [this]{ return notified.load(); } );
+        sleeping = false;
+    }
+
+private:
+    std::atomic<bool> notified{ false };
+    std::atomic<bool> sleeping{ false };
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+
+LoopThread::LoopThread( QObject * parent, QThread::Priority priority )
+    : LoopThread( LoopThreadOptions{ priority, QString(), {} }, parent )
+{
+}
+
+
+LoopThread::LoopThread( const LoopThreadOptions & options, QObject * parent )
+    : QThread( parent )
+    , options( options )
+    , startTime( now() )
+{
+    if ( options.mode == LoopThreadMode::LowLatency )
+        waker = std::make_unique<LowLatencyWaker>();
+    if ( !options.name.isEmpty() )
+        setObjectName( options.name );
+    start( options.priority );
+}
+
+
+LoopThread::~LoopThread()
+{
+    stop();
+    wait();
+}
+
+
+void LoopThread::stop()
+{
+    requestInterruption();
+    quit();
+    if ( waker )
+        waker->wakeUp();
+}
+
+
+LoopThreadShutdownReport LoopThread::shutdown( std::chrono::milliseconds timeout )
+{
+    // Waiting for the own thread would deadlock.
+    assert( QThread::currentThread() != this );
+    auto & dispatcher = detail::ThreadDispatcher::forThread( this );
+    if ( !isShuttingDown.exchange( true ) )
+        dispatcher.close( std::chrono::steady_clock::now() + timeout );
+    stop();
+
+    LoopThreadShutdownReport report;
+    report.finished = wait( static_cast<unsigned long>(
+                std::max<std::int64_t>( timeout.count(), 0 ) ) );
+    // Discarding does not take long, so wait for it.
+    if ( !report.finished && isDiscarding.load() )
+        report.finished = wait();
+    const auto counts = dispatcher.getShutdownCounts();
+    report.executed = counts.first;
+    report.rejected = counts.second;
+    report.discarded = nDiscarded.load();
+    return report;
+}
+
+
+LoopThreadStats LoopThread::stats() const
+{
+    if ( isFinished() )
+    {
+        auto result = finalStats;
+        result.busyRatio = busyRatio( stopTime );
+        return result;
+    }
+    LoopThreadStats result;
+    result.busyRatio = busyRatio( now() );
+#ifdef Q_OS_LINUX
+    if ( isStarted.load( std::memory_order_acquire ) )
+    {
+        // The first field of schedstat is the time spent on the CPU.
+        result.cpuTime = std::chrono::nanoseconds(
+                    readTaskValue( tid, "schedstat" ) );
+        result.voluntaryContextSwitches =
+                readTaskValue( tid, "status", "voluntary_ctxt_switches" );
+        result.involuntaryContextSwitches =
+                readTaskValue( tid, "status", "nonvoluntary_ctxt_switches" );
+    }
+#endif
+    return result;
+}
+
+
+void LoopThread::run()
+{
+    applyOptions();
+    if ( waker )
+        runLowLatency();
+    else
+        runEventLoop();
+
+    if ( isShuttingDown.load() )
+    {
+        auto & dispatcher = detail::ThreadDispatcher::forThread( this );
+        dispatcher.drain();
+        isDiscarding = true;
+        nDiscarded = dispatcher.abandonPending( std::make_exception_ptr(
+                ThreadShutdownError( "The target thread has been shut down "
+                                     "before running the invocation." ) ) );
+    }
+
+#ifdef Q_OS_LINUX
+    rusage usage{};
+    if ( getrusage( RUSAGE_THREAD, &usage ) == 0 )
+    {
+        finalStats.cpuTime =
+                std::chrono::seconds( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) +
+                std::chrono::microseconds( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec );
+        finalStats.voluntaryContextSwitches = std::uint64_t( usage.ru_nvcsw );
+        finalStats.involuntaryContextSwitches = std::uint64_t( usage.ru_nivcsw );
+    }
+#endif
+    stopTime = now();
+}
+
+
+void LoopThread::runEventLoop()
+{
+    // Measure how long the event loop waits for events.
+    const auto dispatcher = eventDispatcher();
+    connect( dispatcher, &QAbstractEventDispatcher::aboutToBlock,
+             dispatcher, [this]()
+    {
+        idleSince = now();
+    }, Qt::DirectConnection );
+    connect( dispatcher, &QAbstractEventDispatcher::awake,
+             dispatcher, [this]()
+    {
+        if ( const auto since = idleSince.exchange( 0 ) )
+            idleTime += now() - since;
+    }, Qt::DirectConnection );
+
+    exec();
+}
+
+
+void LoopThread::runLowLatency()
+{
+    using Clock = std::chrono::steady_clock;
+    auto & dispatcher = detail::ThreadDispatcher::forThread( this );
+    dispatcher.setWaker( waker.get() );
+    auto nextPump = Clock::now();
+    while ( !isInterruptionRequested() )
+    {
+        // Wakeups arriving from here on are remembered.
+        waker->reset();
+        dispatcher.sendPending();
+        if ( Clock::now() >= nextPump )
+        {
+            QCoreApplication::processEvents();
+            // Without a running event loop, deferred deletes need to be
+            // triggered explicitly.
+            QCoreApplication::sendPostedEvents( nullptr, QEvent::DeferredDelete );
+            nextPump = Clock::now() + options.eventPumpInterval;
+        }
+        if ( waker->isNotified() || dispatcher.hasPending() )
+            continue;
+
+        idleSince = now();
+        const auto spinEnd = Clock::now() + options.spinDuration;
+        while ( !waker->isNotified() && Clock::now() < spinEnd )
+            relaxCpu();
+        if ( !waker->isNotified() )
+            waker->waitUntil( nextPump );
+        if ( const auto since = idleSince.exchange( 0 ) )
+            idleTime += now() - since;
+    }
+    dispatcher.setWaker( nullptr );
+}
+
+
+void LoopThread::applyOptions()
+{
+#ifdef Q_OS_LINUX
+    tid = long( syscall( SYS_gettid ) );
+    isStarted.store( true, std::memory_order_release );
+    if ( !options.name.isEmpty() )
+        pthread_setname_np( pthread_self(),
+                            options.name.toUtf8().left( 15 ).constData() );
+    if ( !options.cpus.empty() )
+    {
+        cpu_set_t cpus;
+        CPU_ZERO( &cpus );
+        for ( const auto cpu : options.cpus )
+            if ( cpu >= 0 && cpu < CPU_SETSIZE )
+                CPU_SET( cpu, &cpus );
+        sched_setaffinity( 0, sizeof(cpus), &cpus );
+    }
+#endif
+}
+
+
+double LoopThread::busyRatio( std::int64_t time ) const
+{
+    const auto elapsed = time - startTime;
+    if ( elapsed <= 0 )
+        return 0;
+    const auto since = idleSince.load();
+    const auto idle = idleTime.load() + ( since ? time - since : 0 );
+    return std::clamp( 1 - double(idle) / double(elapsed), 0.0, 1.0 );
+}
+
+} // namespace qu
@@ -5,11 +5,89 @@
 
 #pragma once
 
+#include <QString>
 #include <QThread>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 namespace qu
 {
 
+/// How a @c LoopThread waits for work.
+enum class LoopThreadMode
+{
+    /// A standard Qt event loop.
+    EventLoop,
+    /// @brief Invocations are run directly from a lock-free queue.
+    ///
+    /// The thread spins for a short while before it blocks, and producers
+    /// wake it without going through the Qt event dispatcher. The Qt event
+    /// loop is only pumped periodically, so posted events and timers of
+    /// QObjects living in the thread, including the timers of
+    /// @c invokeInThreadAfter(), are delayed by up to the pump interval.
+    /// @c QThread::quit() does not stop such a thread, @c stop() does.
+    LowLatency,
+};
+
+/// Settings of a @c LoopThread that are applied when it starts.
+struct LoopThreadOptions
+{
+    QThread::Priority priority = QThread::InheritPriority;
+    /// Name of the thread as shown by the OS, e.g. by @c top or @c perf.
+    /// Linux truncates it to 15 characters. Empty means no name.
+    QString name;
+    /// Indices of the CPU cores the thread may run on. Empty means
+    /// no restriction. If the affinity cannot be set, e.g. because one of
+    /// the cores does not exist, then the thread runs unrestricted.
+    std::vector<int> cpus;
+    LoopThreadMode mode = LoopThreadMode::EventLoop;
+    /// For @c LoopThreadMode::LowLatency: how long the thread spins for
+    /// new invocations before it blocks.
+    std::chrono::microseconds spinDuration{ 50 };
+    /// For @c LoopThreadMode::LowLatency: the maximum time between two
+    /// runs of the Qt event loop.
+    std::chrono::microseconds eventPumpInterval{ 1000 };
+};
+
+/// Resource usage of a @c LoopThread since it has been started.
+struct LoopThreadStats
+{
+    /// CPU time consumed by the thread.
+    std::chrono::nanoseconds cpuTime{ 0 };
+    /// Times the thread gave up the CPU by waiting.
+    std::uint64_t voluntaryContextSwitches = 0;
+    /// Times the thread was preempted.
+    std::uint64_t involuntaryContextSwitches = 0;
+    /// Fraction of the wall clock time in which the thread was not
+    /// waiting for events. Spinning counts as waiting.
+    double busyRatio = 0;
+};
+
+/// Outcome of @c LoopThread::shutdown().
+struct LoopThreadShutdownReport
+{
+    /// Whether the thread has finished within the timeout.
+    bool finished = false;
+    /// Invocations run after the shutdown had been requested.
+    std::uint64_t executed = 0;
+    /// Invocations that were still queued at the deadline. Their futures
+    /// hold a @c ThreadShutdownError.
+    std::uint64_t discarded = 0;
+    /// Invocations made after the shutdown had been requested. Their
+    /// futures hold a @c ThreadShutdownError as well.
+    std::uint64_t rejected = 0;
+};
+
+/// @brief A @c QThread running an event loop from construction to
+/// destruction.
+///
+/// Naming the thread and pinning it to CPU cores is supported on Linux
+/// only. On other platforms these options as well as the CPU time and
+/// the context switches of the statistics are ignored.
 class LoopThread
         : public QThread
 {
@@ -17,17 +95,67 @@ class LoopThread
 public:
     explicit LoopThread(
             QObject * parent = nullptr
-            , QThread::Priority priority = QThread::InheritPriority )
-        : QThread( parent )
-    {
-        start( priority );
-    }
-
-    virtual ~LoopThread()
-    {
-        quit();
-        wait();
-    }
+            , QThread::Priority priority = QThread::InheritPriority );
+
+    explicit LoopThread(
+            const LoopThreadOptions & options
+            , QObject * parent = nullptr );
+
+    /// Calls @c stop() and waits for the thread to finish.
+    virtual ~LoopThread();
+
+    /// Makes the thread finish in any mode. This function is thread-safe.
+    void stop();
+
+    /// @brief Stops the thread after running the queued invocations.
+    ///
+    /// From the call on, new invocations of the thread are rejected. The
+    /// event loop is left and the invocations queued so far are run until
+    /// @c timeout has passed. The remaining ones are discarded. The
+    /// function waits at most @c timeout plus the time needed to discard
+    /// the remaining invocations, unless an invocation still runs at the
+    /// deadline. Then it returns without waiting for it and reports the
+    /// thread as not finished. The destructor still waits for the thread
+    /// in any case. This function is thread-safe, but must not be called
+    /// from the thread itself.
+    LoopThreadShutdownReport shutdown( std::chrono::milliseconds timeout );
+
+    /// Returns the resource usage of the thread. After the thread has
+    /// finished, the final usage is returned. This function is thread-safe.
+    LoopThreadStats stats() const;
+
+protected:
+    virtual void run() override;
+
+private:
+    class LowLatencyWaker;
+
+    void applyOptions();
+    void runEventLoop();
+    void runLowLatency();
+    double busyRatio( std::int64_t time ) const;
+
+    const LoopThreadOptions options;
+    // Times in nanoseconds of std::chrono::steady_clock.
+    const std::int64_t startTime;
+    std::int64_t stopTime = 0;
+    // Id of the thread for the OS. Valid once isStarted is set.
+    long tid = 0;
+    std::atomic<bool> isStarted{ false };
+    // Total time spent waiting for events and the time since when the
+    // event loop is waiting or zero.
+    std::atomic<std::int64_t> idleTime{ 0 };
+    std::atomic<std::int64_t> idleSince{ 0 };
+    // Written when the thread finishes.
+    LoopThreadStats finalStats;
+    // Set by shutdown().
+    std::atomic<bool> isShuttingDown{ false };
+    // Set when the thread starts to discard the remaining invocations.
+    std::atomic<bool> isDiscarding{ false };
+    std::atomic<std::uint64_t> nDiscarded{ 0 };
+    // Only for LoopThreadMode::LowLatency. Removed from the dispatcher
+    // before run() returns, which waits for producers calling it.
+    std::unique_ptr<LowLatencyWaker> waker;
 };
 
 } // namespace qu
@@ -0,0 +1,253 @@
+#include "loop_thread_pool.h"
+
+#include "invoke_in_thread.h"
+#include "loop_thread.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <exception>
+#include <mutex>
+
+namespace qu {
+
+namespace { // unnamed
+
+// Maximum number of tasks a worker runs before it returns to its event
+// loop for a moment.
+const int maxBatchSize = 64;
+
+} // unnamed namespace
+
+
+struct LoopThreadPool::Worker
+{
+    std::size_t index = 0;
+    std::unique_ptr<LoopThread> thread;
+    std::mutex mutex;
+    // Tasks submitted by the worker itself, run newest first.
+    std::deque<detail::DispatchTask*> tasks;
+    // Tasks submitted from outside the pool, run oldest first.
+    std::deque<detail::DispatchTask*> injected;
+    // True while a drain of this worker is queued or running.
+    std::atomic<bool> scheduled{ false };
+};
+
+
+namespace { // unnamed
+
+// The worker running in the current thread, if any.
+thread_local const void * currentWorker = nullptr;
+
+} // unnamed namespace
+
+
+LoopThreadPool::LoopThreadPool(
+        std::size_t nWorkers
+        , QThread::Priority priority )
+    : LoopThreadPool( nWorkers, LoopThreadOptions{ priority, QString(), {} } )
+{
+}
+
+
+LoopThreadPool::LoopThreadPool(
+        std::size_t nWorkers
+        , const LoopThreadOptions & options )
+{
+    if ( nWorkers == 0 )
+        nWorkers = std::max( QThread::idealThreadCount(), 1 );
+    workers.reserve( nWorkers );
+    for ( std::size_t i = 0; i != nWorkers; ++i )
+    {
+        workers.push_back( std::make_unique<Worker>() );
+        auto & worker = *workers.back();
+        worker.index = i;
+        auto workerOptions = options;
+        if ( !options.name.isEmpty() )
+            workerOptions.name += QString( "-%1" ).arg( i );
+        worker.thread = std::make_unique<LoopThread>( workerOptions );
+        detail::ThreadDispatcher::forThread( worker.thread.get() ).postInternal(
+            new detail::DispatchTask( [&worker]()
+            {
+                currentWorker = &worker;
+            } ) );
+    }
+}
+
+
+LoopThreadPool::~LoopThreadPool()
+{
+    // Stop all threads first, since running workers may steal from
+    // any deque.
+    for ( auto & worker : workers )
+        worker->thread->stop();
+    // A worker finishing its batch wakes itself up through its thread, so
+    // the thread objects are only released once all of them have finished.
+    for ( auto & worker : workers )
+        worker->thread->wait();
+    for ( auto & worker : workers )
+        worker->thread.reset();
+    // Like the tasks discarded by a dispatcher, the tasks never run
+    // complete their futures with an error.
+    const auto reason = std::make_exception_ptr( ThreadShutdownError(
+            "The thread pool has been destroyed." ) );
+    for ( auto & worker : workers )
+    {
+        for ( auto task : worker->tasks )
+        {
+            task->abandon( reason );
+            delete task;
+        }
+        for ( auto task : worker->injected )
+        {
+            task->abandon( reason );
+            delete task;
+        }
+    }
+}
+
+
+std::size_t LoopThreadPool::size() const
+{
+    return workers.size();
+}
+
+
+QThread * LoopThreadPool::thread( std::size_t index ) const
+{
+    return workers.at( index )->thread.get();
+}
+
+
+void LoopThreadPool::post( detail::DispatchTask * task )
+{
+    assert( task );
+    // Workers of this pool keep their own tasks.
+    const auto it = std::find_if( workers.begin(), workers.end(),
+        []( const std::unique_ptr<Worker> & w )
+        { return w.get() == currentWorker; } );
+    const bool isOwn = it != workers.end();
+    const auto worker = isOwn ?
+                it->get() : workers[nextWorker++ % workers.size()].get();
+
+    {
+        std::lock_guard<std::mutex> lock( worker->mutex );
+        ( isOwn ? worker->tasks : worker->injected ).push_back( task );
+    }
+
+    if ( !worker->scheduled.exchange( true ) )
+    {
+        wakeUp( *worker );
+        return;
+    }
+    // The worker is busy. Let an idle one steal the task.
+    for ( auto & w : workers )
+    {
+        if ( !w->scheduled.load() && !w->scheduled.exchange( true ) )
+        {
+            wakeUp( *w );
+            return;
+        }
+    }
+}
+
+
+void LoopThreadPool::wakeUp( Worker & worker )
+{
+    // There is at most one drain per worker pending, so it is internal.
+    detail::ThreadDispatcher::forThread( worker.thread.get() ).postInternal(
+        new detail::DispatchTask( [this,&worker]()
+        {
+            drain( worker );
+        } ) );
+}
+
+
+void LoopThreadPool::drain( Worker & worker )
+{
+    for ( int i = 0; i != maxBatchSize; ++i )
+    {
+        // Each batch starts with the oldest submitted task, so that a
+        // worker busy with its own tasks does not starve submitted ones.
+        auto task = popLocal( worker, i == 0 );
+        if ( !task )
+            task = steal( worker );
+        if ( !task )
+        {
+            worker.scheduled = false;
+            // Work may have been submitted after the last look, while
+            // producers still saw this worker as scheduled.
+            if ( hasWork() && !worker.scheduled.exchange( true ) )
+                continue;
+            return;
+        }
+
+        // If a task throws, then the worker continues later.
+        struct Guard
+        {
+            ~Guard()
+            {
+                if ( !done )
+                    self->wakeUp( worker );
+            }
+            LoopThreadPool * self;
+            Worker & worker;
+            bool done;
+        } guard{ this, worker, false };
+        std::unique_ptr<detail::DispatchTask>{ task }->operator()();
+        guard.done = true;
+    }
+    // Give the event loop of the worker a chance to run.
+    wakeUp( worker );
+}
+
+
+detail::DispatchTask * LoopThreadPool::popLocal( Worker & worker, bool preferInjected )
+{
+    std::lock_guard<std::mutex> lock( worker.mutex );
+    if ( !worker.injected.empty() &&
+         ( preferInjected || worker.tasks.empty() ) )
+    {
+        const auto task = worker.injected.front();
+        worker.injected.pop_front();
+        return task;
+    }
+    if ( worker.tasks.empty() )
+        return nullptr;
+    const auto task = worker.tasks.back();
+    worker.tasks.pop_back();
+    return task;
+}
+
+
+detail::DispatchTask * LoopThreadPool::steal( Worker & thief )
+{
+    const auto n = workers.size();
+    for ( std::size_t i = 1; i < n; ++i )
+    {
+        auto & victim = *workers[(thief.index + i) % n];
+        std::lock_guard<std::mutex> lock( victim.mutex );
+        // Submitted tasks have waited longest.
+        auto & tasks = victim.injected.empty() ? victim.tasks : victim.injected;
+        if ( tasks.empty() )
+            continue;
+        const auto task = tasks.front();
+        tasks.pop_front();
+        return task;
+    }
+    return nullptr;
+}
+
+
+bool LoopThreadPool::hasWork() const
+{
+    for ( const auto & worker : workers )
+    {
+        std::lock_guard<std::mutex> lock( worker->mutex );
+        if ( !worker->tasks.empty() || !worker->injected.empty() )
+            return true;
+    }
+    return false;
+}
+
+} // namespace qu
@@ -0,0 +1,109 @@
+/// @file
+///
+/// @brief A pool of @c LoopThread workers with work stealing.
+
+#pragma once
+
+#include "future.h"
+#include "loop_thread.h"
+#include "thread_dispatcher.h"
+
+#include <QThread>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace qu
+{
+
+/// @brief A fixed number of @c LoopThread workers sharing work.
+///
+/// Every worker has its own deque of tasks and a queue of tasks submitted
+/// from outside the pool, which are distributed round-robin. Tasks
+/// submitted by a worker go to its own deque. A worker takes new tasks
+/// from the back of its own deque, i.e. newest first, and otherwise from
+/// its queue, oldest first. Each batch of tasks starts with the oldest
+/// queued task, so submitted tasks do not starve. When both are empty, a
+/// worker steals from the front of the queues and deques of the other
+/// workers. Hence tasks of varying cost are balanced over the workers.
+///
+/// Each worker keeps running a Qt event loop. Tasks are executed in
+/// bounded batches from within that loop, so QObjects living in a worker
+/// thread keep receiving their events. Use @c thread() together with
+/// @c invokeInThread() when a functor needs to run in a particular
+/// worker thread.
+class LoopThreadPool
+{
+public:
+    /// Starts @c nWorkers threads. The default is one per CPU core.
+    explicit LoopThreadPool(
+            std::size_t nWorkers = 0
+            , QThread::Priority priority = QThread::InheritPriority );
+
+    /// Starts @c nWorkers threads with the given options, e.g. to keep a
+    /// compute pool off the cores of latency-sensitive threads. A
+    /// non-empty name gets the index of the worker appended.
+    LoopThreadPool(
+            std::size_t nWorkers
+            , const LoopThreadOptions & options );
+
+    /// Stops all workers. Tasks that have not been started yet are
+    /// destroyed without being run.
+    ~LoopThreadPool();
+
+    LoopThreadPool( const LoopThreadPool & ) = delete;
+    LoopThreadPool & operator=( const LoopThreadPool & ) = delete;
+
+    std::size_t size() const;
+
+    /// Returns the thread of the worker with the given index.
+    QThread * thread( std::size_t index ) const;
+
+    /// Enqueues a task for any worker. This function is thread-safe and
+    /// takes ownership of @c task.
+    void post( detail::DispatchTask * task );
+
+private:
+    struct Worker;
+
+    void wakeUp( Worker & worker );
+    void drain( Worker & worker );
+    detail::DispatchTask * popLocal( Worker & worker, bool preferInjected );
+    detail::DispatchTask * steal( Worker & thief );
+    bool hasWork() const;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<std::size_t> nextWorker{ 0 };
+};
+
+
+/// @brief Runs a functor on any worker of @c pool.
+///
+/// The result is provided through the returned future, just like for
+/// @c invokeInThread().
+template <typename F>
+auto invokeInPool( LoopThreadPool & pool, F && f )
+    -> Future<decltype(f())>
+{
+    using RetType = decltype(f());
+    Promise<RetType> promise;
+    auto future = promise.getFuture();
+    pool.post( new detail::DispatchTask( detail::makePromiseTask(
+        std::move(promise),
+        [f = std::forward<F>(f)]( Promise<RetType> & promise ) mutable
+        {
+            detail::fulfil( promise, f );
+        } ) ) );
+    return future;
+}
+
+/// Like @c invokeInPool(), but without providing the result.
+template <typename F>
+void postToPool( LoopThreadPool & pool, F && f )
+{
+    pool.post( new detail::DispatchTask( std::forward<F>(f) ) );
+}
+
+} // namespace qu
@@ -1,29 +1,56 @@
 QT       += core gui
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-QMAKE_CXXFLAGS += -std=c++11 -pedantic
+
+# Supported are Qt 5.14 and later Qt 5 releases, and Qt 6.3 and later.
+!versionAtLeast(QT_VERSION, 5.14.0): error("qt_utils requires Qt 5.14 or later.")
+equals(QT_MAJOR_VERSION, 6):!versionAtLeast(QT_VERSION, 6.3.0): error("qt_utils requires Qt 6.3 or later with Qt 6.")
+
+QMAKE_CXXFLAGS += -std=c++20 -pedantic
 
 TEMPLATE = lib
-CONFIG += staticlib create_prl c++11 link_prl
+CONFIG += staticlib create_prl c++2a link_prl
 DEPENDPATH += . ../cpp_utils/
 INCLUDEPATH += ..
 
 # Input
-HEADERS += event_filter.h \
+HEADERS += actor.h \
+           event_filter.h \
+           event_filter_router.h \
            exception_handling.h \
            exception_handling_application.h \
+           future.h \
+           graphics_item_delegates.h \
            gui_property_sheet.h \
            gui_user_parameter.h \
+           input_coalescing_filter.h \
+           instanced_graphics_item.h \
            invoke_in_thread.h \
+           latency_histogram.h \
            loop_thread.h \
+           loop_thread_pool.h \
            serialize_props.h \
+           stall_watchdog.h \
+           thread_coroutines.h \
+           thread_dispatcher.h \
+           timer_wheel.h \
     gui_progress_widget.h \
     gui_progress_manager.h \
     event_handling_graphics_item.h
 
-SOURCES += exception_handling.cpp \
+SOURCES += event_filter_router.cpp \
+           exception_handling.cpp \
+           graphics_item_delegates.cpp \
            gui_property_sheet.cpp \
            gui_user_parameter.cpp \
+           input_coalescing_filter.cpp \
+           instanced_graphics_item.cpp \
+           latency_histogram.cpp \
+           loop_thread.cpp \
+           loop_thread_pool.cpp \
            serialize_props.cpp \
+           stall_watchdog.cpp \
+           thread_dispatcher.cpp \
+           timer_wheel.cpp \
     gui_progress_widget.cpp \
     gui_progress_manager.cpp
 
@@ -0,0 +1,412 @@
+#include "stall_watchdog.h"
+
+#include "invoke_in_thread.h"
+#include "loop_thread.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <thread>
+#include <utility>
+
+#ifdef Q_OS_LINUX
+#include <cstdlib>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+namespace qu {
+
+namespace { // unnamed
+
+std::int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+#ifdef Q_OS_LINUX
+
+const int maxFrames = 64;
+
+// Written by the signal handler in the sampled thread. Only one thread
+// is sampled at a time. Each request has a sequence number, which is
+// passed along with the signal, so that a handler running late, e.g.
+// after the request has timed out, does not overwrite a later sample.
+std::mutex samplerMutex;
+void * sampledFrames[maxFrames];
+int nSampledFrames = 0;
+// The sequence number of the request being served is marked as claimed
+// by the handler writing the sample.
+const std::uint32_t claimedBit = 0x80000000u;
+std::uint32_t lastSequenceNumber = 0;
+std::atomic<std::uint32_t> requestedSample{ 0 };
+std::atomic<std::uint32_t> completedSample{ 0 };
+
+void sampleHandler( int, siginfo_t * info, void * )
+{
+    auto sequenceNumber = std::uint32_t( info->si_value.sival_int );
+    if ( !requestedSample.compare_exchange_strong(
+             sequenceNumber, sequenceNumber | claimedBit ) )
+        return;
+    nSampledFrames = backtrace( sampledFrames, maxFrames );
+    completedSample.store( sequenceNumber, std::memory_order_release );
+}
+
+int installSampler()
+{
+    // The first call of backtrace() loads libgcc, which is not
+    // async-signal-safe. Hence it is done here.
+    void * frame = nullptr;
+    backtrace( &frame, 1 );
+    const int signalNumber = SIGRTMIN + 7;
+    struct sigaction action{};
+    action.sa_sigaction = sampleHandler;
+    sigemptyset( &action.sa_mask );
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigaction( signalNumber, &action, nullptr );
+    return signalNumber;
+}
+
+std::vector<std::string> sampleBacktrace( pthread_t thread )
+{
+    static const int signalNumber = installSampler();
+    std::lock_guard<std::mutex> lock( samplerMutex );
+    lastSequenceNumber = lastSequenceNumber + 1 < claimedBit ?
+                lastSequenceNumber + 1 : 1;
+    const auto sequenceNumber = lastSequenceNumber;
+    requestedSample = sequenceNumber;
+    sigval value{};
+    value.sival_int = int( sequenceNumber );
+    if ( pthread_sigqueue( thread, signalNumber, value ) != 0 )
+    {
+        requestedSample = 0;
+        return {};
+    }
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds( 100 );
+    while ( completedSample.load( std::memory_order_acquire ) != sequenceNumber )
+    {
+        // The thread may block the signal or be stuck in the kernel. If
+        // the handler has not claimed the request yet, then withdrawing
+        // it keeps the handler from writing. Otherwise it is about to
+        // finish.
+        auto expected = sequenceNumber;
+        if ( std::chrono::steady_clock::now() >= deadline &&
+             requestedSample.compare_exchange_strong( expected, 0 ) )
+            return {};
+        std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+    }
+    requestedSample = 0;
+    const auto nFrames = nSampledFrames;
+    std::vector<std::string> result;
+    const auto symbols = backtrace_symbols( sampledFrames, nFrames );
+    if ( !symbols )
+        return result;
+    // Skip the frames of the signal handler.
+    for ( int i = std::min( 2, nFrames ); i < nFrames; ++i )
+        result.emplace_back( symbols[i] );
+    std::free( symbols );
+    return result;
+}
+
+#endif
+
+} // unnamed namespace
+
+
+struct StallWatchdog::Watched
+{
+    // Called in the watched thread.
+    void respond( std::int64_t sentTime )
+    {
+#ifdef Q_OS_LINUX
+        if ( !hasNativeHandle.load( std::memory_order_acquire ) )
+        {
+            std::lock_guard<std::mutex> lock( handleMutex );
+            if ( !isFinished )
+            {
+                nativeHandle = pthread_self();
+                hasNativeHandle.store( true, std::memory_order_release );
+            }
+        }
+#endif
+        lastResponseTime = now() - sentTime;
+        pingTime.compare_exchange_strong( sentTime, 0 );
+    }
+
+    // A ping that is discarded, e.g. because the thread is shutting down,
+    // is not outstanding, so it does not count as a stall.
+    struct Ping
+    {
+        void operator()()
+        {
+            entry->respond( sentTime );
+        }
+
+        void abandon( std::exception_ptr )
+        {
+            auto expected = sentTime;
+            entry->pingTime.compare_exchange_strong( expected, 0 );
+        }
+
+        std::shared_ptr<Watched> entry;
+        std::int64_t sentTime;
+    };
+
+    // Pings are internal, so they are not counted as invocations of the
+    // thread.
+    static void ping( const std::shared_ptr<Watched> & entry, std::int64_t sentTime )
+    {
+        entry->pingTime = sentTime;
+        const auto task = new detail::DispatchTask( Ping{ entry, sentTime } );
+        task->isInternal = true;
+        detail::ThreadDispatcher::forThread( entry->thread ).postCoalesced(
+                    entry.get(), task );
+    }
+
+    // Called in the watched thread when it finishes.
+    void finish()
+    {
+#ifdef Q_OS_LINUX
+        std::lock_guard<std::mutex> lock( handleMutex );
+        isFinished = true;
+        hasNativeHandle = false;
+#endif
+    }
+
+    // Returns the backtrace of the thread, if it is still running.
+    std::vector<std::string> sample()
+    {
+#ifdef Q_OS_LINUX
+        // The thread cannot finish while its handle is in use.
+        std::lock_guard<std::mutex> lock( handleMutex );
+        if ( hasNativeHandle.load() )
+            return sampleBacktrace( nativeHandle );
+#endif
+        return {};
+    }
+
+    QThread * thread = nullptr;
+    QString name;
+    // Time at which the outstanding ping was sent or zero.
+    std::atomic<std::int64_t> pingTime{ 0 };
+    std::atomic<std::int64_t> lastResponseTime{ 0 };
+#ifdef Q_OS_LINUX
+    std::mutex handleMutex;
+    bool isFinished = false;
+    std::atomic<bool> hasNativeHandle{ false };
+    pthread_t nativeHandle{};
+#endif
+    // The number of the record of the ongoing stall or zero. Only used
+    // by the monitor thread.
+    std::uint64_t stallId = 0;
+};
+
+
+// Lets the connections to the signals of the watched threads call the
+// watchdog only while it is alive.
+struct StallWatchdog::Alive
+{
+    std::mutex mutex;
+    StallWatchdog * watchdog;
+};
+
+
+StallWatchdog::StallWatchdog( const StallWatchdogOptions & options )
+    : options( options )
+    , context( std::make_unique<QObject>() )
+    , alive( std::make_shared<Alive>() )
+{
+    alive->watchdog = this;
+    LoopThreadOptions monitorOptions;
+    monitorOptions.name = "qu-watchdog";
+    monitor = std::make_unique<LoopThread>( monitorOptions );
+    if ( options.watchGuiThread && QCoreApplication::instance() )
+        watch( QCoreApplication::instance()->thread(), "gui" );
+    timer = invokeInThreadEvery( monitor.get(), options.interval,
+                                 [this]{ check(); } );
+}
+
+
+StallWatchdog::~StallWatchdog()
+{
+    // Waits for connections running in watched threads.
+    {
+        std::lock_guard<std::mutex> lock( alive->mutex );
+        alive->watchdog = nullptr;
+    }
+    timer.cancel();
+    monitor.reset();
+    context.reset();
+}
+
+
+void StallWatchdog::watch( QThread * thread, const QString & name )
+{
+    auto entry = std::make_shared<Watched>();
+    entry->thread = thread;
+    entry->name = name.isEmpty() ? thread->objectName() : name;
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        watched.push_back( entry );
+    }
+    // The connections are cut when the watchdog is destroyed, but they may
+    // be running in the watched thread at that time. No signal must be
+    // sent to a thread that has exited.
+    const auto unwatchIfAlive = [alive = alive, thread]()
+    {
+        std::lock_guard<std::mutex> lock( alive->mutex );
+        if ( alive->watchdog )
+            alive->watchdog->unwatch( thread );
+    };
+    QObject::connect( thread, &QThread::finished, context.get(),
+        [entry, unwatchIfAlive]()
+        {
+            entry->finish();
+            unwatchIfAlive();
+        }, Qt::DirectConnection );
+    QObject::connect( thread, &QObject::destroyed, context.get(),
+        unwatchIfAlive, Qt::DirectConnection );
+    Watched::ping( entry, now() );
+}
+
+
+void StallWatchdog::unwatch( QThread * thread )
+{
+    std::lock_guard<std::mutex> lock( mutex );
+    watched.erase( std::remove_if( watched.begin(), watched.end(),
+        [thread]( const std::shared_ptr<Watched> & entry )
+        {
+            return entry->thread == thread;
+        } ), watched.end() );
+}
+
+
+std::chrono::nanoseconds StallWatchdog::responseTime( QThread * thread ) const
+{
+    std::lock_guard<std::mutex> lock( mutex );
+    for ( const auto & entry : watched )
+        if ( entry->thread == thread )
+            return std::chrono::nanoseconds( entry->lastResponseTime.load() );
+    return std::chrono::nanoseconds( 0 );
+}
+
+
+std::vector<StallRecord> StallWatchdog::stalls() const
+{
+    std::lock_guard<std::mutex> lock( mutex );
+    return std::vector<StallRecord>( log.begin(), log.end() );
+}
+
+
+void StallWatchdog::writeLog( std::ostream & stream ) const
+{
+    for ( const auto & record : stalls() )
+    {
+        const auto start = std::chrono::system_clock::to_time_t( record.start );
+        std::tm startTime{};
+#ifdef Q_OS_WIN
+        localtime_s( &startTime, &start );
+#else
+        localtime_r( &start, &startTime );
+#endif
+        stream << std::put_time( &startTime, "%F %T" )
+               << " thread \"" << record.threadName.toStdString()
+               << "\" stalled for "
+               << std::chrono::duration_cast<std::chrono::milliseconds>(
+                      record.duration ).count() << " ms"
+               << ( record.isOngoing ? " (ongoing)" : "" ) << '\n';
+        for ( const auto & frame : record.backtrace )
+            stream << "    " << frame << '\n';
+    }
+}
+
+
+bool StallWatchdog::dumpLog( const QString & fileName ) const
+{
+    std::ofstream file( fileName.toStdString() );
+    writeLog( file );
+    file.close();
+    return !file.fail();
+}
+
+
+void StallWatchdog::check()
+{
+    // Sampling a backtrace may take a while, so it is done without
+    // holding the mutex.
+    std::vector<std::pair<std::shared_ptr<Watched>,std::uint64_t>> newStalls;
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        const auto currentTime = now();
+        const auto threshold = std::chrono::nanoseconds( options.threshold ).count();
+        for ( const auto & entry : watched )
+        {
+            const auto pingTime = entry->pingTime.load();
+            if ( pingTime == 0 )
+            {
+                // The last ping has been answered.
+                if ( const auto record = findRecord( std::exchange( entry->stallId, 0 ) ) )
+                {
+                    record->duration = std::chrono::nanoseconds(
+                                entry->lastResponseTime.load() );
+                    record->isOngoing = false;
+                }
+                Watched::ping( entry, currentTime );
+                continue;
+            }
+            const auto elapsed = currentTime - pingTime;
+            if ( entry->stallId != 0 )
+            {
+                if ( const auto record = findRecord( entry->stallId ) )
+                    record->duration = std::chrono::nanoseconds( elapsed );
+                continue;
+            }
+            if ( elapsed < threshold )
+                continue;
+
+            StallRecord record;
+            record.threadName = entry->name;
+            record.start = std::chrono::system_clock::now() -
+                           std::chrono::nanoseconds( elapsed );
+            record.duration = std::chrono::nanoseconds( elapsed );
+            record.isOngoing = true;
+            log.push_back( std::move(record) );
+            entry->stallId = firstRecordId + log.size() - 1;
+            newStalls.emplace_back( entry, entry->stallId );
+            if ( log.size() > options.logCapacity )
+            {
+                log.pop_front();
+                ++firstRecordId;
+            }
+        }
+    }
+
+    for ( const auto & stall : newStalls )
+    {
+        auto backtrace = stall.first->sample();
+        if ( backtrace.empty() )
+            continue;
+        std::lock_guard<std::mutex> lock( mutex );
+        if ( const auto record = findRecord( stall.second ) )
+            record->backtrace = std::move(backtrace);
+    }
+}
+
+
+StallRecord * StallWatchdog::findRecord( std::uint64_t id )
+{
+    if ( id == 0 || id < firstRecordId || id - firstRecordId >= log.size() )
+        return nullptr;
+    return &log[id - firstRecordId];
+}
+
+} // namespace qu
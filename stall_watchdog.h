@@ -0,0 +1,128 @@
+/// @file
+///
+/// @brief Detection of event loops that stop responding.
+
+#pragma once
+
+#include "thread_dispatcher.h"
+
+#include <QObject>
+#include <QString>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class QThread;
+
+namespace qu
+{
+
+class LoopThread;
+
+/// A period in which a watched event loop did not respond.
+struct StallRecord
+{
+    QString threadName;
+    /// When the unanswered ping was sent.
+    std::chrono::system_clock::time_point start;
+    /// Time until the ping was answered or, for an ongoing stall, until
+    /// the last check.
+    std::chrono::nanoseconds duration{ 0 };
+    bool isOngoing = false;
+    /// Symbolized frames of the stuck thread at the time the stall has
+    /// been detected, innermost first. Empty, if not supported.
+    std::vector<std::string> backtrace;
+};
+
+struct StallWatchdogOptions
+{
+    /// Time between two checks of each thread.
+    std::chrono::milliseconds interval{ 100 };
+    /// Response time from which on a thread counts as stalled.
+    std::chrono::milliseconds threshold{ 500 };
+    /// Maximum number of records kept. Older ones are discarded.
+    std::size_t logCapacity = 100;
+    /// Whether the Qt gui thread is watched from the start.
+    bool watchGuiThread = true;
+};
+
+/// @brief Watches event loops and records when they stall.
+///
+/// A monitor thread pings every watched thread at a fixed interval by
+/// posting a functor to it, and measures the time until it has run. Pings
+/// are coalesced per thread and bypass the capacity limit of its queue,
+/// so the monitor never blocks on a stuck thread. If
+/// a ping stays unanswered longer than the threshold, then a
+/// @c StallRecord is added to a bounded in-memory log. On Linux the record
+/// contains a backtrace of the stuck thread, which is taken by sending it
+/// a real-time signal whose handler samples the stack. Since a thread
+/// needs to have answered a ping once for that, threads are pinged
+/// right when they start being watched.
+///
+/// Threads are unwatched automatically when they finish or their
+/// @c QThread object is destroyed.
+class StallWatchdog
+{
+public:
+    explicit StallWatchdog(
+            const StallWatchdogOptions & options = StallWatchdogOptions() );
+
+    ~StallWatchdog();
+
+    StallWatchdog( const StallWatchdog & ) = delete;
+    StallWatchdog & operator=( const StallWatchdog & ) = delete;
+
+    /// Starts watching @c thread, which must run a Qt event loop. An empty
+    /// name is replaced by the object name of the thread. This function is
+    /// thread-safe.
+    void watch( QThread * thread, const QString & name = QString() );
+
+    /// This function is thread-safe.
+    void unwatch( QThread * thread );
+
+    /// Returns the time the last ping of @c thread took to be answered.
+    /// This function is thread-safe.
+    std::chrono::nanoseconds responseTime( QThread * thread ) const;
+
+    /// Returns the recorded stalls, oldest first. This function is
+    /// thread-safe.
+    std::vector<StallRecord> stalls() const;
+
+    /// Writes the recorded stalls in a human readable form.
+    void writeLog( std::ostream & stream ) const;
+
+    /// Writes the recorded stalls to a file. Returns whether that
+    /// succeeded.
+    bool dumpLog( const QString & fileName ) const;
+
+private:
+    struct Watched;
+    struct Alive;
+
+    void check();
+    StallRecord * findRecord( std::uint64_t id );
+
+    const StallWatchdogOptions options;
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<Watched>> watched;
+    std::deque<StallRecord> log;
+    // Records are numbered consecutively. This is the number of the first
+    // one in the log.
+    std::uint64_t firstRecordId = 1;
+    // Context of the connections to QObject::destroyed of the threads.
+    std::unique_ptr<QObject> context;
+    // Shared with the connections, which may run in other threads while
+    // the watchdog is destroyed.
+    std::shared_ptr<Alive> alive;
+    TimerHandle timer;
+    // Destroyed first, so no check is running afterwards.
+    std::unique_ptr<LoopThread> monitor;
+};
+
+} // namespace qu
@@ -0,0 +1,206 @@
+/// @file
+///
+/// @brief Coroutine support for hopping between threads.
+///
+/// A function returning a @c qu::Future can be written as a coroutine.
+/// Inside it, <tt>co_await qu::resumeOn(thread)</tt> continues execution
+/// in the event loop of @c thread and <tt>co_await future</tt> suspends
+/// until a @c qu::Future is ready without blocking the current thread:
+///
+/// @code
+///     qu::Future<void> updatePlot( QThread * worker, Plot * plot )
+///     {
+///         co_await qu::resumeOn( worker );
+///         auto data = computeExpensiveData();
+///         co_await qu::resumeOnGui();
+///         plot->setData( std::move(data) );
+///     }
+/// @endcode
+
+#pragma once
+
+#include "future.h"
+#include "invoke_in_thread.h"
+
+#include <QApplication>
+#include <QThread>
+
+#include <coroutine>
+#include <utility>
+
+namespace qu
+{
+
+namespace detail
+{
+
+    /// @brief Resumes a coroutine when called.
+    ///
+    /// If the task is destroyed without having been called, e.g. because
+    /// the target thread went away, then the coroutine frame is destroyed.
+    /// This breaks the promise of the coroutine, so no awaiting party
+    /// waits forever.
+    class ResumeTask
+    {
+    public:
+        explicit ResumeTask( std::coroutine_handle<> handle )
+            : handle( handle )
+        {
+        }
+
+        ResumeTask( ResumeTask && other ) noexcept
+            : handle( std::exchange( other.handle, nullptr ) )
+        {
+        }
+
+        ~ResumeTask()
+        {
+            if ( handle )
+                handle.destroy();
+        }
+
+        void operator()()
+        {
+            std::exchange( handle, nullptr ).resume();
+        }
+
+    private:
+        std::coroutine_handle<> handle;
+    };
+
+
+    template <typename T>
+    struct FuturePromiseBase
+    {
+        Future<T> get_return_object()
+        {
+            return promise.getFuture();
+        }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void unhandled_exception()
+        {
+            promise.setException( std::current_exception() );
+        }
+
+        Promise<T> promise;
+    };
+
+    template <typename T>
+    struct FuturePromise
+        : FuturePromiseBase<T>
+    {
+        template <typename U>
+        void return_value( U && value )
+        {
+            this->promise.setValue( std::forward<U>(value) );
+        }
+    };
+
+    template <>
+    struct FuturePromise<void>
+        : FuturePromiseBase<void>
+    {
+        void return_void()
+        {
+            this->promise.setValue();
+        }
+    };
+
+
+    template <typename T>
+    class FutureAwaiter
+    {
+    public:
+        explicit FutureAwaiter( Future<T> && future )
+            : future( std::move(future) )
+        {
+        }
+
+        bool await_ready() const
+        {
+            return future.isReady();
+        }
+
+        void await_suspend( std::coroutine_handle<> handle )
+        {
+            future.state->setContinuation( QThread::currentThread(),
+                new DispatchTask( ResumeTask( handle ) ) );
+        }
+
+        T await_resume()
+        {
+            return future.get();
+        }
+
+    private:
+        Future<T> future;
+    };
+
+} // namespace detail
+
+
+/// @brief Awaitable that continues a coroutine in the event loop of @c thread.
+///
+/// If @c thread is the current thread, then the coroutine is not
+/// suspended.
+inline auto resumeOn( QThread * thread )
+{
+    struct Awaiter
+    {
+        bool await_ready() const
+        {
+            return thread == QThread::currentThread();
+        }
+
+        void await_suspend( std::coroutine_handle<> handle ) const
+        {
+            postToThread( thread, detail::ResumeTask( handle ),
+                          Qt::QueuedConnection );
+        }
+
+        void await_resume() const noexcept
+        {
+        }
+
+        QThread * thread;
+    };
+    return Awaiter{ thread };
+}
+
+/// Like @c resumeOn(), but continues in the Qt gui thread.
+inline auto resumeOnGui()
+{
+    return resumeOn( QApplication::instance()->thread() );
+}
+
+/// @brief Suspends a coroutine until @c future is ready.
+///
+/// The coroutine is resumed in the event loop of the thread in which it
+/// was suspended. Hence that thread must run a Qt event loop. The result
+/// of the @c co_await expression is the value of the future. A stored
+/// exception is rethrown. Afterwards @c future is not valid anymore.
+template <typename T>
+detail::FutureAwaiter<T> operator co_await( Future<T> && future )
+{
+    return detail::FutureAwaiter<T>( std::move(future) );
+}
+
+template <typename T>
+detail::FutureAwaiter<T> operator co_await( Future<T> & future )
+{
+    return detail::FutureAwaiter<T>( std::move(future) );
+}
+
+} // namespace qu
+
+
+/// Makes every function returning a @c qu::Future usable as a coroutine.
+/// The coroutine starts executing eagerly in the calling thread.
+template <typename T, typename...Args>
+struct std::coroutine_traits<qu::Future<T>, Args...>
+{
+    using promise_type = qu::detail::FuturePromise<T>;
+};
@@ -0,0 +1,945 @@
+#include "thread_dispatcher.h"
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QThread>
+#include <QTimerEvent>
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <climits>
+#include <memory>
+#include <thread>
+
+namespace qu {
+
+namespace detail {
+
+namespace { // unnamed
+
+const QEvent::Type dispatchEventType =
+        static_cast<QEvent::Type>( QEvent::registerEventType() );
+
+// Tells the dispatcher which lane to run.
+struct DispatchEvent
+    : QEvent
+{
+    explicit DispatchEvent( InvokePriority priority )
+        : QEvent( dispatchEventType )
+        , priority( priority )
+    {
+    }
+
+    const InvokePriority priority;
+};
+
+const int eventPriorities[] = {
+    Qt::HighEventPriority,
+    Qt::NormalEventPriority,
+    Qt::LowEventPriority,
+};
+
+const std::chrono::microseconds defaultBackgroundBudget{ 4000 };
+
+std::int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// The tick of the timer wheels.
+using TimerTick = std::chrono::milliseconds;
+
+std::uint64_t currentTick()
+{
+    return std::uint64_t( std::chrono::floor<TimerTick>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+std::uint64_t toTicks( std::chrono::nanoseconds duration )
+{
+    return std::uint64_t( std::chrono::ceil<TimerTick>(
+        std::max( duration, std::chrono::nanoseconds( 0 ) ) ).count() );
+}
+
+// Rounds the deadline up to a multiple of a power of two of about 1/32 of
+// the delay. Thus timeouts with nearby deadlines expire in the same tick.
+std::uint64_t coalescedDeadline( std::chrono::nanoseconds delay )
+{
+    const auto deadline = toTicks(
+        std::chrono::steady_clock::now().time_since_epoch() + delay );
+    const auto slack = std::bit_floor( toTicks( delay ) / 32 );
+    if ( slack <= 1 )
+        return deadline;
+    return ( deadline + slack - 1 ) / slack * slack;
+}
+
+struct Registry
+{
+    std::mutex mutex;
+    std::unordered_map<QThread*,ThreadDispatcher*> dispatchers;
+};
+
+Registry & getRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+// Incremented whenever a dispatcher is deleted. The address of its thread
+// may be reused by a new thread afterwards, so the cached dispatchers of
+// all threads become stale.
+std::atomic<std::uint64_t> registryGeneration{ 0 };
+
+// The dispatchers looked up recently by this thread, so posting does not
+// take the mutex of the registry. The cache is direct mapped.
+struct DispatcherCache
+{
+    static const std::size_t nEntries = 8;
+
+    struct Entry
+    {
+        QThread * thread = nullptr;
+        ThreadDispatcher * dispatcher = nullptr;
+    };
+
+    Entry & entryFor( QThread * thread )
+    {
+        return entries[ ( reinterpret_cast<std::uintptr_t>(thread) /
+                          alignof(QThread) ) % nEntries ];
+    }
+
+    Entry entries[nEntries];
+    std::uint64_t generation = 0;
+};
+
+thread_local DispatcherCache dispatcherCache;
+
+// Recycled task objects. Released tasks are pushed onto the global free
+// list. A thread allocating a task takes the whole list at once into its
+// thread local cache. Since the global list is only ever popped as a
+// whole, there is no ABA problem.
+std::atomic<void*> freeTasks{ nullptr };
+
+void pushFreeTasks( void * first, void * last )
+{
+    auto head = freeTasks.load( std::memory_order_relaxed );
+    do
+    {
+        *static_cast<void**>(last) = head;
+    }
+    while ( !freeTasks.compare_exchange_weak( head, first,
+                std::memory_order_release, std::memory_order_relaxed ) );
+}
+
+struct TaskCache
+{
+    ~TaskCache()
+    {
+        // Hand the cached tasks back for other threads to use.
+        if ( !head )
+            return;
+        auto last = head;
+        while ( const auto next = *static_cast<void**>(last) )
+            last = next;
+        pushFreeTasks( head, last );
+    }
+
+    void * head = nullptr;
+};
+
+thread_local TaskCache taskCache;
+
+// Abandons and deletes a chain of tasks. Returns the number of those that
+// are not internal.
+std::size_t abandonChain( DispatchTask * task, const std::exception_ptr & reason )
+{
+    std::size_t n = 0;
+    while ( task )
+    {
+        const auto next = task->next;
+        if ( !task->isInternal )
+            ++n;
+        task->abandon( reason );
+        delete task;
+        task = next;
+    }
+    return n;
+}
+
+} // unnamed namespace
+
+
+std::atomic<bool> isInstrumentationEnabled{ false };
+
+
+void * DispatchTask::operator new( std::size_t size )
+{
+    assert( size == sizeof(DispatchTask) );
+    static_assert( sizeof(DispatchTask) >= sizeof(void*),
+                   "Free tasks must be able to hold a link." );
+    auto & cache = taskCache;
+    if ( !cache.head )
+        cache.head = freeTasks.exchange( nullptr, std::memory_order_acquire );
+    if ( !cache.head )
+        return ::operator new( size );
+    const auto p = cache.head;
+    cache.head = *static_cast<void**>(p);
+    return p;
+}
+
+
+void DispatchTask::operator delete( void * p )
+{
+    if ( p )
+        pushFreeTasks( p, p );
+}
+
+
+ThreadDispatcher & ThreadDispatcher::forThread( QThread * thread )
+{
+    assert( thread );
+    auto & cache = dispatcherCache;
+    const auto generation = registryGeneration.load( std::memory_order_acquire );
+    if ( cache.generation != generation )
+    {
+        cache = DispatcherCache();
+        cache.generation = generation;
+    }
+    auto & entry = cache.entryFor( thread );
+    if ( entry.thread == thread )
+        return *entry.dispatcher;
+
+    auto & registry = getRegistry();
+    std::lock_guard<std::mutex> lock( registry.mutex );
+    auto & dispatcher = registry.dispatchers[thread];
+    if ( !dispatcher )
+    {
+        auto newDispatcher = std::unique_ptr<ThreadDispatcher>(
+                    new ThreadDispatcher );
+        newDispatcher->moveToThread( thread );
+        // The thread is not running anymore, when its QThread object is
+        // destroyed. Hence the dispatcher can be deleted from here.
+        QObject::connect( thread, &QObject::destroyed, [thread]()
+        {
+            auto & registry = getRegistry();
+            std::unique_ptr<ThreadDispatcher> dispatcher;
+            {
+                std::lock_guard<std::mutex> lock( registry.mutex );
+                const auto it = registry.dispatchers.find( thread );
+                if ( it == registry.dispatchers.end() )
+                    return;
+                dispatcher.reset( it->second );
+                registry.dispatchers.erase( it );
+                registryGeneration.fetch_add( 1, std::memory_order_release );
+            }
+        } );
+        dispatcher = newDispatcher.release();
+    }
+    // If a dispatcher has been deleted since the generation was loaded,
+    // then the entry is discarded by the next lookup.
+    entry.thread = thread;
+    entry.dispatcher = dispatcher;
+    return *dispatcher;
+}
+
+
+// Queued in place of the latest task posted with a key. If the placeholder
+// is discarded, then so is that task.
+class ThreadDispatcher::CoalescedPlaceholder
+{
+public:
+    CoalescedPlaceholder( ThreadDispatcher * dispatcher, const void * key )
+        : dispatcher( dispatcher )
+        , key( key )
+    {
+    }
+
+    CoalescedPlaceholder( CoalescedPlaceholder && other ) noexcept
+        : dispatcher( std::exchange( other.dispatcher, nullptr ) )
+        , key( other.key )
+    {
+    }
+
+    ~CoalescedPlaceholder()
+    {
+        if ( dispatcher )
+            dispatcher->takeCoalesced( key );
+    }
+
+    void operator()()
+    {
+        const auto task = std::exchange( dispatcher, nullptr )->takeCoalesced( key );
+        (*task)();
+    }
+
+    void abandon( std::exception_ptr reason )
+    {
+        if ( dispatcher )
+            std::exchange( dispatcher, nullptr )->takeCoalesced( key )->abandon(
+                        std::move(reason) );
+    }
+
+private:
+    ThreadDispatcher * dispatcher;
+    const void * key;
+};
+
+
+// Counts a producer from its check whether the dispatcher is closed until
+// it has pushed its task, so that abandonPending() can wait for it.
+class ThreadDispatcher::PostingScope
+{
+public:
+    explicit PostingScope( ThreadDispatcher * dispatcher )
+        : dispatcher( dispatcher )
+    {
+        ++dispatcher->nPosting;
+    }
+
+    ~PostingScope()
+    {
+        --dispatcher->nPosting;
+    }
+
+    PostingScope( const PostingScope & ) = delete;
+    PostingScope & operator=( const PostingScope & ) = delete;
+
+private:
+    ThreadDispatcher * const dispatcher;
+};
+
+
+ThreadDispatcher::ThreadDispatcher()
+    : backgroundBudget( defaultBackgroundBudget.count() )
+    , timers( currentTick() )
+{
+}
+
+
+ThreadDispatcher::~ThreadDispatcher()
+{
+    const auto reason = std::make_exception_ptr( ThreadShutdownError(
+            "The target thread has been destroyed." ) );
+    for ( auto & lane : lanes )
+    {
+        abandonChain( lane.batch, reason );
+        abandonChain( lane.pending.exchange( nullptr ), reason );
+    }
+    // The placeholders have deleted all coalesced tasks.
+    assert( coalesced.empty() );
+    while ( dueTimers )
+        delete std::exchange( dueTimers, dueTimers->next );
+}
+
+
+void ThreadDispatcher::post( DispatchTask * task, InvokePriority priority )
+{
+    assert( task );
+    PostingScope scope( this );
+    if ( !rejectIfClosed( task ) && admit( task ) )
+        push( task, priority );
+}
+
+
+void ThreadDispatcher::postInternal( DispatchTask * task, InvokePriority priority )
+{
+    assert( task );
+    task->isInternal = true;
+    PostingScope scope( this );
+    if ( rejectIfClosed( task ) )
+        return;
+    ++depth;
+    push( task, priority );
+}
+
+
+void ThreadDispatcher::postCoalesced(
+        const void * key, DispatchTask * task, InvokePriority priority )
+{
+    assert( task );
+    PostingScope scope( this );
+    if ( rejectIfClosed( task ) )
+        return;
+    std::unique_ptr<DispatchTask> replaced;
+    {
+        std::lock_guard<std::mutex> lock( coalescedMutex );
+        auto & slot = coalesced[key];
+        replaced.reset( slot );
+        slot = task;
+    }
+    // The placeholder of the replaced task is still queued. Placeholders
+    // are internal, since there is at most one per key.
+    if ( !replaced )
+    {
+        // The placeholder counts as the task it stands for.
+        const auto placeholder =
+                new DispatchTask( CoalescedPlaceholder( this, key ) );
+        placeholder->isInternal = task->isInternal;
+        placeholder->isEvictable = false;
+        ++depth;
+        push( placeholder, priority );
+    }
+}
+
+
+void ThreadDispatcher::schedule(
+        std::unique_ptr<ScheduledTask> task, std::chrono::nanoseconds delay )
+{
+    assert( task );
+    PostingScope scope( this );
+    // A timer counts as one rejected invocation, however often it would
+    // have fired. The request registering it is internal and not counted.
+    if ( closed.load() )
+    {
+        ++nRejectedWhileClosed;
+        return;
+    }
+    task->deadline = coalescedDeadline( delay );
+    // Like placeholders, timer requests are internal, so no timer gets
+    // lost.
+    const auto request = new DispatchTask( [this, task = std::move(task)]() mutable
+    {
+        addTimer( std::move(task) );
+    } );
+    request->isInternal = true;
+    ++depth;
+    push( request, InvokePriority::Normal );
+}
+
+
+void ThreadDispatcher::runPending()
+{
+    runLane( InvokePriority::Interactive );
+    runLane( InvokePriority::Normal );
+    runLane( InvokePriority::Background );
+}
+
+
+void ThreadDispatcher::setWaker( Waker * waker_ )
+{
+    waker = waker_;
+    // Producers that have loaded the previous waker may still call it.
+    // New ones load the new waker, since all accesses are sequentially
+    // consistent.
+    while ( nWaking.load() > 0 )
+        std::this_thread::yield();
+    if ( waker_ )
+        return;
+    // Tasks pushed meanwhile may have woken the previous waker only.
+    for ( int i = 0; i != 3; ++i )
+        if ( lanes[i].batch || lanes[i].pending.load() )
+            scheduleWakeUp( InvokePriority(i) );
+}
+
+
+bool ThreadDispatcher::hasPending() const
+{
+    for ( const auto & lane : lanes )
+        if ( lane.batch || lane.pending.load( std::memory_order_relaxed ) )
+            return true;
+    return false;
+}
+
+
+void ThreadDispatcher::sendPending()
+{
+    for ( int i = 0; i != 3; ++i )
+    {
+        auto & lane = lanes[i];
+        if ( !lane.batch && !lane.pending.load( std::memory_order_relaxed ) )
+            continue;
+        DispatchEvent event{ InvokePriority(i) };
+        QCoreApplication::sendEvent( this, &event );
+    }
+}
+
+
+void ThreadDispatcher::close( std::chrono::steady_clock::time_point deadline )
+{
+    closeDeadline = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                deadline.time_since_epoch() ).count();
+    if ( !closed.exchange( true ) )
+        nExecutedAtClose = nExecuted.load();
+    // Producers blocked by OverflowPolicy::Block are rejected now.
+    std::lock_guard<std::mutex> lock( capacityMutex );
+    capacityCv.notify_all();
+}
+
+
+void ThreadDispatcher::drain()
+{
+    assert( closed.load() );
+    while ( hasPending() && !isPastCloseDeadline() )
+        sendPending();
+}
+
+
+std::size_t ThreadDispatcher::abandonPending( const std::exception_ptr & reason )
+{
+    assert( closed.load() );
+    // Producers that have seen the dispatcher open are about to push
+    // their tasks. Later ones see it closed, since all accesses are
+    // sequentially consistent.
+    while ( nPosting.load() > 0 )
+        std::this_thread::yield();
+    std::size_t n = 0;
+    for ( auto & lane : lanes )
+    {
+        const auto batch = std::exchange( lane.batch, nullptr );
+        const auto pending = takePending( lane );
+        for ( const auto chain : { batch, pending } )
+            for ( auto task = chain; task; task = task->next )
+                releaseSlot();
+        n += abandonChain( batch, reason );
+        n += abandonChain( pending, reason );
+    }
+    return n;
+}
+
+
+std::pair<std::uint64_t,std::uint64_t> ThreadDispatcher::getShutdownCounts() const
+{
+    if ( !closed.load() )
+        return { 0, 0 };
+    return { nExecuted.load() - nExecutedAtClose.load(),
+             nRejectedWhileClosed.load() };
+}
+
+
+void ThreadDispatcher::setBackgroundBudget( std::chrono::microseconds budget )
+{
+    backgroundBudget = budget.count();
+}
+
+
+void ThreadDispatcher::setCapacity( std::size_t capacity_, OverflowPolicy policy_ )
+{
+    {
+        std::lock_guard<std::mutex> lock( capacityMutex );
+        policy = policy_;
+        capacity = capacity_;
+    }
+    capacityCv.notify_all();
+}
+
+
+InvokeQueueStats ThreadDispatcher::getQueueStats() const
+{
+    InvokeQueueStats stats;
+    stats.depth = depth.load();
+    stats.capacity = capacity.load();
+    stats.dropped = nDropped.load();
+    stats.rejected = nRejected.load();
+    return stats;
+}
+
+
+InvokeLatencyStats ThreadDispatcher::getLatencyStats() const
+{
+    InvokeLatencyStats stats;
+    stats.queueDelay = queueDelays.summarize();
+    stats.execution = executionTimes.summarize();
+    return stats;
+}
+
+
+void ThreadDispatcher::resetLatencyStats()
+{
+    // The histograms have a single writer without read-modify-writes, so
+    // clearing them concurrently could be undone by that writer.
+    if ( thread() == QThread::currentThread() )
+    {
+        queueDelays.reset();
+        executionTimes.reset();
+        return;
+    }
+    const auto task = new DispatchTask( [this]
+    {
+        queueDelays.reset();
+        executionTimes.reset();
+    } );
+    task->isInternal = true;
+    postCoalesced( &queueDelays, task );
+}
+
+
+bool ThreadDispatcher::rejectIfClosed( DispatchTask * task )
+{
+    if ( !closed.load() )
+        return false;
+    if ( !task->isInternal )
+        ++nRejectedWhileClosed;
+    task->abandon( std::make_exception_ptr( ThreadShutdownError(
+            "The target thread is shutting down." ) ) );
+    delete task;
+    return true;
+}
+
+
+bool ThreadDispatcher::isPastCloseDeadline() const
+{
+    return closed.load( std::memory_order_relaxed ) &&
+            now() >= closeDeadline.load( std::memory_order_relaxed );
+}
+
+
+bool ThreadDispatcher::admit( DispatchTask * task )
+{
+    while ( !tryReserveSlot() )
+    {
+        switch ( policy.load() )
+        {
+        case OverflowPolicy::Block:
+            // Waiting for the own event loop would deadlock.
+            if ( thread() == QThread::currentThread() )
+            {
+                ++depth;
+                return true;
+            }
+            {
+                std::unique_lock<std::mutex> lock( capacityMutex );
+                ++nBlocked;
+                capacityCv.wait( lock, [this]()
+                {
+                    const auto limit = capacity.load();
+                    return limit == 0 || depth.load() < limit || closed.load();
+                } );
+                --nBlocked;
+            }
+            if ( rejectIfClosed( task ) )
+                return false;
+            break;
+        case OverflowPolicy::DropOldest:
+            if ( const auto evicted = evictOldest() )
+            {
+                ++nDropped;
+                delete evicted;
+                break;
+            }
+            // Only tasks that are about to run are left.
+            [[fallthrough]];
+        case OverflowPolicy::DropNewest:
+            ++nDropped;
+            delete task;
+            return false;
+        case OverflowPolicy::Fail:
+            ++nRejected;
+            task->abandon( std::make_exception_ptr( QueueFullError(
+                    "The invocation queue of the target thread is full." ) ) );
+            delete task;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool ThreadDispatcher::tryReserveSlot()
+{
+    const auto limit = capacity.load();
+    auto current = depth.load();
+    do
+    {
+        if ( limit != 0 && current >= limit )
+            return false;
+    }
+    while ( !depth.compare_exchange_weak( current, current + 1 ) );
+    return true;
+}
+
+
+void ThreadDispatcher::releaseSlot()
+{
+    --depth;
+    if ( nBlocked.load() > 0 )
+    {
+        std::lock_guard<std::mutex> lock( capacityMutex );
+        capacityCv.notify_all();
+    }
+}
+
+
+DispatchTask * ThreadDispatcher::evictOldest()
+{
+    std::lock_guard<std::mutex> lock( evictionMutex );
+    for ( int i = 2; i >= 0; --i )
+    {
+        auto & lane = lanes[i];
+        auto chain = lane.pending.exchange( nullptr, std::memory_order_acquire );
+        if ( !chain )
+            continue;
+        // The stack is ordered newest first.
+        DispatchTask * previous = nullptr;
+        DispatchTask * oldest = nullptr;
+        DispatchTask * before = nullptr;
+        for ( auto task = chain; task; before = task, task = task->next )
+        {
+            if ( task->isEvictable && !task->isInternal )
+            {
+                previous = before;
+                oldest = task;
+            }
+        }
+        if ( oldest )
+        {
+            if ( previous )
+                previous->next = oldest->next;
+            else
+                chain = oldest->next;
+        }
+        pushBack( lane, chain, InvokePriority(i) );
+        if ( !oldest )
+            continue;
+        --depth;
+        return oldest;
+    }
+    return nullptr;
+}
+
+
+void ThreadDispatcher::push( DispatchTask * task, InvokePriority priority )
+{
+    task->enqueueTime = isInstrumentationEnabled.load( std::memory_order_relaxed ) ?
+                now() : 0;
+    auto & pending = lanes[int(priority)].pending;
+    auto head = pending.load( std::memory_order_relaxed );
+    do
+    {
+        task->next = head;
+    }
+    while ( !pending.compare_exchange_weak( head, task,
+                std::memory_order_release, std::memory_order_relaxed ) );
+
+    // Only the producer that finds the stack empty needs to wake up
+    // the consumer. All others piggy-back on that event.
+    if ( !head )
+        scheduleWakeUp( priority );
+}
+
+
+void ThreadDispatcher::pushBack(
+        Lane & lane, DispatchTask * chain, InvokePriority priority )
+{
+    // Puts a chain of older tasks underneath the tasks that have been
+    // pushed meanwhile.
+    while ( chain )
+    {
+        DispatchTask * expected = nullptr;
+        if ( lane.pending.compare_exchange_strong( expected, chain,
+                std::memory_order_release, std::memory_order_relaxed ) )
+        {
+            scheduleWakeUp( priority );
+            return;
+        }
+        auto newer = lane.pending.exchange( nullptr, std::memory_order_acquire );
+        if ( !newer )
+            continue;
+        auto last = newer;
+        while ( last->next )
+            last = last->next;
+        last->next = chain;
+        chain = newer;
+    }
+}
+
+
+DispatchTask * ThreadDispatcher::takePending( Lane & lane )
+{
+    std::unique_lock<std::mutex> lock( evictionMutex, std::defer_lock );
+    if ( policy.load() == OverflowPolicy::DropOldest )
+        lock.lock();
+    return lane.pending.exchange( nullptr, std::memory_order_acquire );
+}
+
+
+void ThreadDispatcher::runLane( InvokePriority priority )
+{
+    auto & lane = lanes[int(priority)];
+    if ( !lane.batch )
+    {
+        // Take the whole stack and reverse it into FIFO order.
+        auto head = takePending( lane );
+        while ( head )
+        {
+            const auto next = head->next;
+            head->next = lane.batch;
+            lane.batch = head;
+            head = next;
+        }
+    }
+
+    // If a task throws or the time slice is used up, then the rest of
+    // the batch is run later. After the deadline of close() it is left
+    // to be abandoned.
+    struct Guard
+    {
+        ~Guard()
+        {
+            if ( lane.batch && !self->isPastCloseDeadline() )
+                self->scheduleWakeUp( priority );
+        }
+        ThreadDispatcher * self;
+        Lane & lane;
+        InvokePriority priority;
+    } guard{ this, lane, priority };
+
+    const bool isBackground = priority == InvokePriority::Background;
+    const auto deadline = isBackground ?
+        std::chrono::steady_clock::now() +
+            std::chrono::microseconds( backgroundBudget.load() ) :
+        std::chrono::steady_clock::time_point::max();
+    while ( lane.batch )
+    {
+        if ( isPastCloseDeadline() )
+            break;
+        std::unique_ptr<DispatchTask> task( lane.batch );
+        lane.batch = task->next;
+        releaseSlot();
+        if ( !task->isInternal )
+            nExecuted.store( nExecuted.load( std::memory_order_relaxed ) + 1,
+                             std::memory_order_relaxed );
+        if ( const auto enqueueTime = task->enqueueTime )
+        {
+            const auto startTime = now();
+            queueDelays.record( std::chrono::nanoseconds( startTime - enqueueTime ) );
+            (*task)();
+            executionTimes.record( std::chrono::nanoseconds( now() - startTime ) );
+        }
+        else
+            (*task)();
+        if ( isBackground && ( hasPendingAbove( priority ) ||
+                std::chrono::steady_clock::now() >= deadline ) )
+            break;
+    }
+}
+
+
+std::unique_ptr<DispatchTask> ThreadDispatcher::takeCoalesced( const void * key )
+{
+    std::lock_guard<std::mutex> lock( coalescedMutex );
+    const auto it = coalesced.find( key );
+    assert( it != coalesced.end() );
+    std::unique_ptr<DispatchTask> task( it->second );
+    coalesced.erase( it );
+    return task;
+}
+
+
+bool ThreadDispatcher::hasPendingAbove( InvokePriority priority ) const
+{
+    for ( int i = 0; i < int(priority); ++i )
+        if ( lanes[i].batch || lanes[i].pending.load( std::memory_order_relaxed ) )
+            return true;
+    return false;
+}
+
+
+bool ThreadDispatcher::event( QEvent * event )
+{
+    if ( event->type() != dispatchEventType )
+        return QObject::event( event );
+    runLane( static_cast<DispatchEvent*>(event)->priority );
+    return true;
+}
+
+
+void ThreadDispatcher::timerEvent( QTimerEvent * event )
+{
+    if ( event->timerId() != nativeTimerId )
+    {
+        QObject::timerEvent( event );
+        return;
+    }
+    killTimer( std::exchange( nativeTimerId, 0 ) );
+    armedTick = TimerWheel::never;
+    runTimers();
+}
+
+
+void ThreadDispatcher::scheduleWakeUp( InvokePriority priority )
+{
+    ++nWaking;
+    if ( const auto w = waker.load() )
+    {
+        w->wakeUp();
+        --nWaking;
+        return;
+    }
+    --nWaking;
+    QCoreApplication::postEvent( this, new DispatchEvent( priority ),
+                                 eventPriorities[int(priority)] );
+}
+
+
+void ThreadDispatcher::addTimer( std::unique_ptr<ScheduledTask> task )
+{
+    timers.add( task.release() );
+    armTimer();
+}
+
+
+void ThreadDispatcher::runTimers()
+{
+    const auto now = currentTick();
+    auto tail = &dueTimers;
+    while ( *tail )
+        tail = &(*tail)->next;
+    *tail = timers.advance( now );
+
+    // If a task throws, then the remaining ones are run with the next
+    // timer event.
+    struct Guard
+    {
+        ~Guard()
+        {
+            self->armTimer();
+        }
+        ThreadDispatcher * self;
+    } guard{ this };
+
+    while ( dueTimers )
+    {
+        std::unique_ptr<ScheduledTask> timer(
+                    static_cast<ScheduledTask*>( dueTimers ) );
+        dueTimers = timer->next;
+        if ( timer->cancelled->load() )
+            continue;
+        auto & task = *timer->task;
+        if ( timer->period.count() != 0 )
+        {
+            // Periods that have been missed are skipped. The timer is
+            // rescheduled before running, so it survives exceptions.
+            const auto period = std::max<std::uint64_t>(
+                        toTicks( timer->period ), 1 );
+            timer->deadline += period;
+            if ( timer->deadline <= now )
+                timer->deadline = now + period;
+            timers.add( timer.release() );
+        }
+        task();
+    }
+}
+
+
+void ThreadDispatcher::armTimer()
+{
+    const auto next = dueTimers ? 0 : timers.nextExpiry();
+    if ( nativeTimerId != 0 && next == armedTick )
+        return;
+    if ( nativeTimerId != 0 )
+        killTimer( std::exchange( nativeTimerId, 0 ) );
+    armedTick = next;
+    if ( next == TimerWheel::never )
+        return;
+    const auto now = currentTick();
+    const auto delay = next > now ?
+                std::min<std::uint64_t>( next - now, INT_MAX ) : 0;
+    nativeTimerId = startTimer( int(delay), Qt::PreciseTimer );
+}
+
+
+} // namespace detail
+
+} // namespace qu
@@ -0,0 +1,636 @@
+/// @file
+///
+/// @brief Per-thread queue of functors that is drained by the event loop
+///     of the owning @c QThread.
+
+#pragma once
+
+#include "latency_histogram.h"
+#include "timer_wheel.h"
+
+#include <QObject>
+
+#include <QThread>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <unordered_map>
+
+class QEvent;
+class QTimerEvent;
+
+namespace qu
+{
+
+/// @brief Urgency of an invocation in the event loop of a thread.
+///
+/// @c Interactive invocations are run before all other posted events.
+/// @c Background invocations are run after other posted events and only
+/// for a limited time per event loop iteration. This keeps a flood of
+/// low-value updates from delaying input handling and repaints.
+enum class InvokePriority
+{
+    Interactive,
+    Normal,
+    Background,
+};
+
+/// @brief What happens when an invocation is made while the invocation
+/// queue of the target thread is full.
+///
+/// See @c setInvokeQueueCapacity().
+enum class OverflowPolicy
+{
+    /// The producer waits until the queue has room again.
+    Block,
+    /// The oldest pending invocation of the lowest priority is discarded.
+    DropOldest,
+    /// The new invocation is discarded.
+    DropNewest,
+    /// The new invocation is discarded and its future, if any, receives
+    /// a @c QueueFullError.
+    Fail,
+};
+
+/// Exception stored in the future of an invocation that has been rejected
+/// with @c OverflowPolicy::Fail.
+class QueueFullError
+    : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/// Exception stored in the future of an invocation that has been discarded
+/// because its target thread shut down.
+class ThreadShutdownError
+    : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/// Counters of the invocation queue of a thread.
+struct InvokeQueueStats
+{
+    /// Invocations that have been queued, but not started yet.
+    std::size_t depth = 0;
+    /// Maximum depth or zero for no limit.
+    std::size_t capacity = 0;
+    /// Invocations discarded by @c OverflowPolicy::DropOldest or
+    /// @c OverflowPolicy::DropNewest.
+    std::uint64_t dropped = 0;
+    /// Invocations rejected by @c OverflowPolicy::Fail.
+    std::uint64_t rejected = 0;
+};
+
+/// Latencies of the invocations in a thread, see
+/// @c setInvokeInstrumentationEnabled().
+struct InvokeLatencyStats
+{
+    /// Time from queueing an invocation until it is started.
+    LatencySummary queueDelay;
+    /// Time from starting an invocation until it returns.
+    LatencySummary execution;
+};
+
+/// @brief Handle of a delayed or periodic invocation.
+///
+/// See @c invokeInThreadAfter() and @c invokeInThreadEvery(). Copies refer
+/// to the same invocation. Destroying a handle does not cancel it.
+class TimerHandle
+{
+public:
+    TimerHandle() = default;
+
+    explicit TimerHandle( std::shared_ptr<std::atomic<bool>> cancelled )
+        : cancelled( std::move(cancelled) )
+    {
+    }
+
+    /// @brief Stops the invocation.
+    ///
+    /// This function is thread-safe. When called in the target thread,
+    /// the functor is not called anymore afterwards. A call that is in
+    /// progress in the target thread is completed.
+    void cancel()
+    {
+        if ( cancelled )
+            cancelled->store( true );
+    }
+
+    bool isCancelled() const
+    {
+        return cancelled && cancelled->load();
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
+namespace detail
+{
+
+    /// Whether enqueued tasks are timestamped.
+    extern std::atomic<bool> isInstrumentationEnabled;
+
+    /// @brief A queued functor.
+    ///
+    /// Tasks are linked into the pending stack of a @c ThreadDispatcher and
+    /// deleted after they have been run. Functors of up to
+    /// @c inlineCapacity bytes are stored inline, larger ones on the heap.
+    /// The task objects themselves have a fixed size and are recycled
+    /// through a lock-free pool, so posting a small functor does not touch
+    /// the global heap once the pool is warmed up.
+    class DispatchTask
+    {
+    public:
+        // Enough for a member function pointer, an object pointer and a
+        // few arguments. With the other members a task takes 80 bytes on
+        // 64 bit platforms.
+        static const std::size_t inlineCapacity = 6 * sizeof(void*);
+
+        template <typename F>
+        explicit DispatchTask( F && f )
+        {
+            typedef typename std::decay<F>::type Functor;
+            construct<Functor>( std::forward<F>(f),
+                std::integral_constant<bool,
+                    sizeof(Functor) <= inlineCapacity &&
+                    alignof(Functor) <= alignof(std::max_align_t)>() );
+        }
+
+        ~DispatchTask()
+        {
+            manage( Destroy, storage, nullptr );
+        }
+
+        DispatchTask( const DispatchTask & ) = delete;
+        DispatchTask & operator=( const DispatchTask & ) = delete;
+
+        void operator()()
+        {
+            manage( Invoke, storage, nullptr );
+        }
+
+        /// @brief Tells the functor that it will be destroyed without
+        /// being run.
+        ///
+        /// Functors providing a member function @c abandon(std::exception_ptr)
+        /// get @c reason passed to it, e.g. to complete a future with
+        /// an error. For other functors this is a no-op.
+        void abandon( std::exception_ptr reason )
+        {
+            manage( Abandon, storage, &reason );
+        }
+
+        static void * operator new( std::size_t size );
+        static void operator delete( void * p );
+
+        DispatchTask * next = nullptr;
+        /// Time of enqueueing in nanoseconds of @c std::chrono::steady_clock
+        /// or zero, if invocations are not instrumented.
+        std::int64_t enqueueTime = 0;
+        /// Set for tasks posted by the utilities for their own bookkeeping,
+        /// see @c ThreadDispatcher::postInternal(). They are not counted
+        /// in the shutdown counts.
+        bool isInternal = false;
+        /// Cleared for tasks that must not be dropped, e.g. those that a
+        /// producer waits for. Like internal tasks they are never evicted
+        /// by @c OverflowPolicy::DropOldest.
+        bool isEvictable = true;
+
+    private:
+        enum Operation { Invoke, Abandon, Destroy };
+
+        template <typename Functor>
+        static void apply( Operation op, Functor & functor,
+                           std::exception_ptr * reason )
+        {
+            if ( op == Invoke )
+                functor();
+            else if constexpr ( requires { functor.abandon( *reason ); } )
+                functor.abandon( *reason );
+        }
+
+        template <typename Functor, typename F>
+        void construct( F && f, std::true_type /*inline*/ )
+        {
+            new (storage) Functor( std::forward<F>(f) );
+            manage = []( Operation op, void * p, std::exception_ptr * reason )
+            {
+                auto & functor = *static_cast<Functor*>(p);
+                if ( op == Destroy )
+                    functor.~Functor();
+                else
+                    apply( op, functor, reason );
+            };
+        }
+
+        template <typename Functor, typename F>
+        void construct( F && f, std::false_type /*inline*/ )
+        {
+            new (storage) Functor*( new Functor( std::forward<F>(f) ) );
+            manage = []( Operation op, void * p, std::exception_ptr * reason )
+            {
+                const auto functor = *static_cast<Functor**>(p);
+                if ( op == Destroy )
+                    delete functor;
+                else
+                    apply( op, *functor, reason );
+            };
+        }
+
+        void (*manage)( Operation, void *, std::exception_ptr * );
+        alignas(std::max_align_t) unsigned char storage[inlineCapacity];
+    };
+
+
+    /// A functor that is run by the timer wheel of a dispatcher.
+    struct ScheduledTask
+        : TimerWheel::Entry
+    {
+        template <typename F>
+        ScheduledTask( F && f, std::shared_ptr<std::atomic<bool>> cancelled,
+                       std::chrono::nanoseconds period )
+            : task( new DispatchTask( std::forward<F>(f) ) )
+            , cancelled( std::move(cancelled) )
+            , period( period )
+        {
+        }
+
+        std::unique_ptr<DispatchTask> task;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        /// Zero for a single invocation.
+        std::chrono::nanoseconds period;
+    };
+
+
+    /// @brief Runs functors in the event loop of a particular thread.
+    ///
+    /// There is exactly one dispatcher per @c QThread. It lives in that
+    /// thread and is destroyed together with the @c QThread object.
+    /// Producers push tasks onto a lock-free multi-producer/single-consumer
+    /// stack. Only the producer which finds the stack empty posts an event
+    /// to the dispatcher, so a burst of invocations costs a single wakeup.
+    /// When the event is delivered, the whole stack is taken at once and
+    /// run in FIFO order.
+    ///
+    /// There is one such stack per @c InvokePriority. Interactive tasks are
+    /// woken up with a high event priority. Background tasks are woken up
+    /// with a low event priority and are run only for a limited time slice
+    /// per event. A background slice also ends as soon as tasks of a higher
+    /// priority are pending. The remaining background tasks are continued
+    /// with a new event, so the event loop can process input and paint
+    /// events in between.
+    ///
+    /// Optionally the number of queued tasks is limited. Producers reserve
+    /// a slot by incrementing the queue depth, the consumer frees it when
+    /// it starts a task. What happens when no slot is free is determined by
+    /// the @c OverflowPolicy. For @c OverflowPolicy::DropOldest, an
+    /// overflowing producer evicts the oldest evictable task of the pending
+    /// stack of the lowest priority. It does so under a mutex which the
+    /// consumer also takes while it grabs a pending stack, so the queue
+    /// order is kept. Internal tasks and tasks that a producer waits for
+    /// are skipped.
+    ///
+    /// If instrumentation is enabled, then tasks are timestamped when they
+    /// are enqueued and the dispatcher records their queue delays and
+    /// execution times in histograms.
+    ///
+    /// Delayed and periodic tasks are kept in a @c TimerWheel with a
+    /// resolution of one millisecond, which is driven by a single native
+    /// timer. The native timer is armed for the next expiry of the wheel
+    /// only. Deadlines are rounded up to about 1/32 of their delay, so
+    /// that timeouts with nearby deadlines expire in the same tick and
+    /// cause a single wakeup. Cancelled tasks are dropped lazily when
+    /// they expire.
+    class ThreadDispatcher
+        : public QObject
+    {
+    public:
+        /// @brief Wakes up a thread that runs the dispatcher itself
+        /// instead of a Qt event loop.
+        ///
+        /// See @c setWaker().
+        class Waker
+        {
+        public:
+            /// Called by producers, if tasks are pending. Must be
+            /// thread-safe.
+            virtual void wakeUp() = 0;
+
+        protected:
+            ~Waker() = default;
+        };
+
+        /// Returns the dispatcher of @c thread. It is created on first use.
+        /// Each thread caches the dispatchers it has looked up recently, so
+        /// repeated lookups take no lock.
+        static ThreadDispatcher & forThread( QThread * thread );
+
+        ~ThreadDispatcher();
+
+        /// Enqueues a task. This function is thread-safe and takes
+        /// ownership of @c task.
+        void post( DispatchTask * task,
+                   InvokePriority priority = InvokePriority::Normal );
+
+        /// @brief Enqueues a task on which other utilities depend, such as
+        /// the drain of an actor.
+        ///
+        /// The task bypasses the capacity limit, is never evicted and is
+        /// not counted as executed in the shutdown counts. Only a bounded
+        /// number of internal tasks may be pending at any time. This
+        /// function is thread-safe and takes ownership of @c task.
+        void postInternal( DispatchTask * task,
+                           InvokePriority priority = InvokePriority::Normal );
+
+        /// @brief Enqueues a task that replaces a pending task with the same key.
+        ///
+        /// If a task with the same @c key is still pending, then that task
+        /// is destroyed without being run and @c task takes its place in
+        /// the queue. Otherwise @c task is enqueued like with @c post().
+        /// This function is thread-safe and takes ownership of @c task.
+        void postCoalesced( const void * key, DispatchTask * task,
+                            InvokePriority priority = InvokePriority::Normal );
+
+        /// @brief Runs a task after @c delay and then every @c task->period,
+        /// if that is not zero.
+        ///
+        /// The task is inserted into the timer wheel by a posted task, so
+        /// that the wheel is only accessed by the thread of the dispatcher.
+        /// This function is thread-safe.
+        void schedule( std::unique_ptr<ScheduledTask> task,
+                       std::chrono::nanoseconds delay );
+
+        /// Runs the tasks enqueued so far, most urgent ones first. Must be
+        /// called in the thread of the dispatcher.
+        void runPending();
+
+        /// @brief Makes producers call @c waker instead of posting events.
+        ///
+        /// The thread of the dispatcher must then call @c sendPending()
+        /// after every wakeup. Passing @c nullptr switches back to posted
+        /// events. This function is thread-safe. It waits until calls of
+        /// the previous waker that are in progress have returned, so that
+        /// the previous waker may be destroyed afterwards.
+        void setWaker( Waker * waker );
+
+        /// Returns whether tasks are waiting to be run. Must be called in
+        /// the thread of the dispatcher.
+        bool hasPending() const;
+
+        /// Runs the pending tasks like @c runPending(), but wrapped into
+        /// events that are sent through @c QCoreApplication::notify(), so
+        /// that exceptions are handled as for posted events. Must be
+        /// called in the thread of the dispatcher.
+        void sendPending();
+
+        /// @brief Rejects all tasks posted from now on.
+        ///
+        /// Rejected tasks are abandoned with a @c ThreadShutdownError.
+        /// Delayed and periodic tasks are dropped. Queued tasks are not
+        /// started anymore after @c deadline. They stay queued until
+        /// @c abandonPending() is called or the dispatcher is destroyed.
+        /// This function is thread-safe.
+        void close( std::chrono::steady_clock::time_point deadline =
+                        std::chrono::steady_clock::time_point::max() );
+
+        /// @brief Runs pending tasks until none are left or the deadline
+        /// passed to @c close() has passed.
+        ///
+        /// Tasks are run through @c sendPending(). Must be called in the
+        /// thread of the dispatcher after @c close().
+        void drain();
+
+        /// Abandons all pending tasks with @c reason and returns the
+        /// number of those that are not internal. Tasks of producers that
+        /// have passed the check for @c close() are waited for. Must be
+        /// called in the thread of the dispatcher after @c close().
+        std::size_t abandonPending( const std::exception_ptr & reason );
+
+        /// Returns the number of tasks run and the number of tasks rejected
+        /// since @c close() has been called. Internal tasks are not
+        /// counted. This function is thread-safe.
+        std::pair<std::uint64_t,std::uint64_t> getShutdownCounts() const;
+
+        /// Sets the maximum time spent on background tasks per event.
+        /// This function is thread-safe.
+        void setBackgroundBudget( std::chrono::microseconds budget );
+
+        /// Limits the number of queued tasks. Zero means no limit.
+        /// This function is thread-safe.
+        void setCapacity( std::size_t capacity, OverflowPolicy policy );
+
+        /// This function is thread-safe.
+        InvokeQueueStats getQueueStats() const;
+
+        /// This function is thread-safe.
+        InvokeLatencyStats getLatencyStats() const;
+
+        /// @brief Clears the recorded latencies.
+        ///
+        /// The latencies are only recorded by the thread of the dispatcher,
+        /// so called from another thread, the reset is queued to it like
+        /// an invocation of normal priority.
+        /// This function is thread-safe.
+        void resetLatencyStats();
+
+    protected:
+        virtual bool event( QEvent * event ) override;
+        virtual void timerEvent( QTimerEvent * event ) override;
+
+    private:
+        struct Lane
+        {
+            // Tasks pushed by producers, newest first.
+            std::atomic<DispatchTask*> pending{ nullptr };
+            // Tasks taken from @c pending, oldest first. Only accessed
+            // by the thread of the dispatcher.
+            DispatchTask * batch = nullptr;
+        };
+
+        class CoalescedPlaceholder;
+        class PostingScope;
+
+        ThreadDispatcher();
+
+        bool rejectIfClosed( DispatchTask * task );
+        bool isPastCloseDeadline() const;
+        bool admit( DispatchTask * task );
+        bool tryReserveSlot();
+        void releaseSlot();
+        DispatchTask * evictOldest();
+        void push( DispatchTask * task, InvokePriority priority );
+        void pushBack( Lane & lane, DispatchTask * chain,
+                       InvokePriority priority );
+        DispatchTask * takePending( Lane & lane );
+        void runLane( InvokePriority priority );
+        std::unique_ptr<DispatchTask> takeCoalesced( const void * key );
+        bool hasPendingAbove( InvokePriority priority ) const;
+        void scheduleWakeUp( InvokePriority priority );
+        void addTimer( std::unique_ptr<ScheduledTask> task );
+        void runTimers();
+        void armTimer();
+
+        Lane lanes[3];
+        // Pending tasks of postCoalesced() by key. Each of them has a
+        // placeholder task in one of the lanes.
+        std::mutex coalescedMutex;
+        std::unordered_map<const void*,DispatchTask*> coalesced;
+        std::atomic<std::chrono::microseconds::rep> backgroundBudget;
+        std::atomic<Waker*> waker{ nullptr };
+        // Number of producers that may be calling the waker.
+        std::atomic<int> nWaking{ 0 };
+
+        std::atomic<std::size_t> depth{ 0 };
+        std::atomic<std::size_t> capacity{ 0 };
+        std::atomic<OverflowPolicy> policy{ OverflowPolicy::Block };
+        std::atomic<std::uint64_t> nDropped{ 0 };
+        std::atomic<std::uint64_t> nRejected{ 0 };
+        // Producers blocked by OverflowPolicy::Block wait here.
+        std::mutex capacityMutex;
+        std::condition_variable capacityCv;
+        std::atomic<int> nBlocked{ 0 };
+        // Serializes evictions with the consumer taking pending stacks.
+        std::mutex evictionMutex;
+
+        // Set by close(). The deadline is in nanoseconds of
+        // std::chrono::steady_clock.
+        std::atomic<bool> closed{ false };
+        std::atomic<std::int64_t> closeDeadline{
+                std::numeric_limits<std::int64_t>::max() };
+        std::atomic<std::uint64_t> nExecutedAtClose{ 0 };
+        std::atomic<std::uint64_t> nRejectedWhileClosed{ 0 };
+        // Producers between their check of closed and their push.
+        std::atomic<int> nPosting{ 0 };
+
+        // Tasks run that are not internal. Only written by the thread of
+        // the dispatcher.
+        std::atomic<std::uint64_t> nExecuted{ 0 };
+        LatencyHistogram queueDelays;
+        LatencyHistogram executionTimes;
+
+        // Only accessed by the thread of the dispatcher.
+        TimerWheel timers;
+        // Expired timers that have not been run yet, oldest first.
+        TimerWheel::Entry * dueTimers = nullptr;
+        int nativeTimerId = 0;
+        std::uint64_t armedTick = TimerWheel::never;
+    };
+
+
+    /// @brief Runs a functor owned by a waiting thread.
+    ///
+    /// The waiting thread is released when the task is destroyed, whether
+    /// it has been run or abandoned.
+    template <typename F>
+    class BlockingTask
+    {
+    public:
+        BlockingTask( F & f, std::promise<void> & done )
+            : f( &f )
+            , done( &done )
+        {
+        }
+
+        BlockingTask( BlockingTask && other ) noexcept
+            : f( other.f )
+            , done( std::exchange( other.done, nullptr ) )
+        {
+        }
+
+        ~BlockingTask()
+        {
+            if ( done )
+                done->set_value();
+        }
+
+        void operator()()
+        {
+            (*f)();
+        }
+
+        void abandon( std::exception_ptr reason )
+        {
+            if constexpr ( requires { f->abandon( reason ); } )
+                f->abandon( std::move(reason) );
+        }
+
+    private:
+        F * f;
+        std::promise<void> * done;
+    };
+
+
+    /// @brief Runs @c f in the thread @c thread according to @c connectionType.
+    ///
+    /// The semantics of the connection type are the same as for
+    /// @c QMetaObject::invokeMethod().
+    template <typename F>
+    void dispatch( QThread * thread, F && f,
+                   Qt::ConnectionType connectionType )
+    {
+        const bool isCurrentThread = thread == QThread::currentThread();
+        switch ( connectionType )
+        {
+        case Qt::DirectConnection:
+            f();
+            return;
+        case Qt::AutoConnection:
+            if ( isCurrentThread )
+            {
+                f();
+                return;
+            }
+            break;
+        case Qt::BlockingQueuedConnection:
+            // Waiting for the own event loop would deadlock.
+            if ( isCurrentThread )
+            {
+                f();
+                return;
+            }
+            {
+                std::promise<void> done;
+                auto future = done.get_future();
+                const auto task = new DispatchTask(
+                    BlockingTask<std::remove_reference_t<F>>( f, done ) );
+                // Evicting the task would release the caller without
+                // running f.
+                task->isEvictable = false;
+                ThreadDispatcher::forThread( thread ).post( task );
+                future.wait();
+            }
+            return;
+        default:
+            break;
+        }
+        ThreadDispatcher::forThread( thread ).post(
+                    new DispatchTask( std::forward<F>(f) ) );
+    }
+
+    /// Queues @c f in the thread @c thread with the given priority.
+    template <typename F>
+    void dispatch( QThread * thread, F && f, InvokePriority priority )
+    {
+        ThreadDispatcher::forThread( thread ).post(
+                    new DispatchTask( std::forward<F>(f) ), priority );
+    }
+
+} // namespace detail
+
+} // namespace qu
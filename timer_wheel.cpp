@@ -0,0 +1,146 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace qu {
+
+namespace detail {
+
+namespace { // unnamed
+
+void deleteChain( TimerWheel::Entry * entry )
+{
+    while ( entry )
+        delete std::exchange( entry, entry->next );
+}
+
+// Mask of the bits above bit @c index.
+std::uint64_t bitsAbove( int index )
+{
+    return index == 63 ? 0 : ~std::uint64_t(0) << (index + 1);
+}
+
+} // unnamed namespace
+
+
+TimerWheel::TimerWheel( std::uint64_t now )
+    : current( now )
+{
+}
+
+
+TimerWheel::~TimerWheel()
+{
+    for ( auto & level : buckets )
+        for ( auto & slot : level )
+            deleteChain( slot );
+    deleteChain( overflow );
+    deleteChain( due );
+}
+
+
+void TimerWheel::add( Entry * entry )
+{
+    place( entry );
+}
+
+
+TimerWheel::Entry * TimerWheel::advance( std::uint64_t now )
+{
+    for ( auto tick = nextTick(); tick <= now; tick = nextTick() )
+    {
+        current = tick;
+        processTick();
+    }
+    current = std::max( current, now );
+    const auto result = std::exchange( due, nullptr );
+    dueTail = &due;
+    return result;
+}
+
+
+std::uint64_t TimerWheel::nextExpiry() const
+{
+    return due ? current : nextTick();
+}
+
+
+void TimerWheel::place( Entry * entry )
+{
+    if ( entry->deadline <= current )
+    {
+        entry->next = nullptr;
+        *dueTail = entry;
+        dueTail = &entry->next;
+        return;
+    }
+    // The highest digit in which the deadline differs from the current
+    // time determines the level.
+    const int level = ( std::bit_width( entry->deadline ^ current ) - 1 ) / slotBits;
+    if ( level >= nLevels )
+    {
+        entry->next = overflow;
+        overflow = entry;
+        return;
+    }
+    const int slot = int( entry->deadline >> (level * slotBits) ) & (nSlots - 1);
+    entry->next = buckets[level][slot];
+    buckets[level][slot] = entry;
+    occupied[level] |= std::uint64_t(1) << slot;
+}
+
+
+void TimerWheel::cascade( Entry * chain )
+{
+    while ( chain )
+        place( std::exchange( chain, chain->next ) );
+}
+
+
+void TimerWheel::processTick()
+{
+    const int rangeBits = nLevels * slotBits;
+    if ( ( current & ( (std::uint64_t(1) << rangeBits) - 1 ) ) == 0 )
+        cascade( std::exchange( overflow, nullptr ) );
+    for ( int level = nLevels - 1; level >= 0; --level )
+    {
+        const int shift = level * slotBits;
+        if ( ( current & ( (std::uint64_t(1) << shift) - 1 ) ) != 0 )
+            continue;
+        const int slot = int( current >> shift ) & (nSlots - 1);
+        if ( !( occupied[level] & (std::uint64_t(1) << slot) ) )
+            continue;
+        occupied[level] &= ~(std::uint64_t(1) << slot);
+        // Entries of level 0 expire now, the others move down.
+        cascade( std::exchange( buckets[level][slot], nullptr ) );
+    }
+}
+
+
+std::uint64_t TimerWheel::nextTick() const
+{
+    auto result = never;
+    for ( int level = 0; level != nLevels; ++level )
+    {
+        const int shift = level * slotBits;
+        const int index = int( current >> shift ) & (nSlots - 1);
+        const auto mask = occupied[level] & bitsAbove( index );
+        if ( !mask )
+            continue;
+        const auto base = current >> (shift + slotBits) << (shift + slotBits);
+        const auto slot = std::uint64_t( std::countr_zero( mask ) );
+        result = std::min( result, base | slot << shift );
+    }
+    if ( overflow )
+    {
+        const int rangeBits = nLevels * slotBits;
+        result = std::min( result, ( (current >> rangeBits) + 1 ) << rangeBits );
+    }
+    return result;
+}
+
+} // namespace detail
+
+} // namespace qu
@@ -0,0 +1,90 @@
+/// @file
+///
+/// @brief Hierarchical timer wheel for scheduling many timeouts cheaply.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+namespace qu
+{
+
+namespace detail
+{
+
+    /// @brief Timeouts sorted into buckets of a hierarchy of wheels.
+    ///
+    /// Time is measured in integer ticks. There are @c nLevels wheels of
+    /// @c nSlots buckets each. A slot of level @c l spans <tt>nSlots^l</tt>
+    /// ticks. An entry is put into the lowest level whose slot contains
+    /// its deadline, but not the current time. When the current time
+    /// reaches a slot of a higher level, then its entries are cascaded down
+    /// into the lower levels. Entries that lie beyond the range of the
+    /// highest level wait in an overflow list. Adding an entry is O(1) and
+    /// advancing the time only visits occupied buckets.
+    ///
+    /// The wheel is not thread-safe.
+    class TimerWheel
+    {
+    public:
+        /// Base class of the entries, which are linked intrusively.
+        struct Entry
+        {
+            virtual ~Entry() = default;
+
+            std::uint64_t deadline = 0;
+            Entry * next = nullptr;
+        };
+
+        static const std::uint64_t never =
+                std::numeric_limits<std::uint64_t>::max();
+
+        explicit TimerWheel( std::uint64_t now );
+
+        /// Deletes all entries.
+        ~TimerWheel();
+
+        TimerWheel( const TimerWheel & ) = delete;
+        TimerWheel & operator=( const TimerWheel & ) = delete;
+
+        /// Takes ownership of @c entry. An entry whose deadline has passed
+        /// already is returned by the next call to @c advance().
+        void add( Entry * entry );
+
+        /// @brief Moves the current time forward to @c now.
+        ///
+        /// Returns the chain of expired entries in the order of their
+        /// deadlines. The caller takes ownership of them.
+        Entry * advance( std::uint64_t now );
+
+        /// @brief Returns the tick at which @c advance() should be called
+        /// next or @c never, if there are no entries.
+        ///
+        /// The returned tick may be earlier than the earliest deadline, if
+        /// entries have to be cascaded down before.
+        std::uint64_t nextExpiry() const;
+
+    private:
+        static const int slotBits = 6;
+        static const int nSlots = 1 << slotBits;
+        static const int nLevels = 4;
+
+        void place( Entry * entry );
+        void cascade( Entry * chain );
+        void processTick();
+        std::uint64_t nextTick() const;
+
+        std::uint64_t current;
+        Entry * buckets[nLevels][nSlots] = {};
+        // Bit i is set iff the slot i of the level is not empty.
+        std::uint64_t occupied[nLevels] = {};
+        Entry * overflow = nullptr;
+        // Expired entries in FIFO order.
+        Entry * due = nullptr;
+        Entry ** dueTail = &due;
+    };
+
+} // namespace detail
+
+} // namespace qu